@@ -1,207 +1,2479 @@
 #include "analyzer.h"
-#include <fstream>
+#include "chunk_reader.h"
+#include "instrument.h"
 #include <algorithm>
 #include <iostream>
 #include <vector>
 #include <cctype>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <unordered_set>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TRIP_HAVE_AVX2_ARGMAX 1
+#endif
 
 // Helper to remove whitespace and carriage returns
-static std::string trim(const std::string &str)
+static std::string_view trim(std::string_view str)
 {
-    if (str.empty())
-        return "";
     size_t first = 0;
     while (first < str.size() && std::isspace(static_cast<unsigned char>(str[first])))
     {
         first++;
     }
-    if (first == str.size())
-        return "";
-
-    size_t last = str.size() - 1;
-    while (last > first && std::isspace(static_cast<unsigned char>(str[last])))
+    size_t last = str.size();
+    while (last > first && std::isspace(static_cast<unsigned char>(str[last - 1])))
     {
         last--;
     }
-    return str.substr(first, last - first + 1);
+    return str.substr(first, last - first);
 }
 
-void TripAnalyzer::ingestFile(const std::string &csvPath)
+// Splits `line` on `delim` into out[0..lastNeeded] and stops there: columns
+// past the last one we need are never scanned. Returns how many columns
+// were filled: lastNeeded + 1, or fewer if the row is shorter.
+template <char Delim>
+static inline int splitFields(std::string_view line, int lastNeeded, std::string_view *out)
+{
+    size_t start = 0;
+    for (int col = 0; col < lastNeeded; ++col)
+    {
+        size_t end = line.find(Delim, start);
+        if (end == std::string_view::npos)
+        {
+            out[col] = line.substr(start);
+            return col + 1;
+        }
+        out[col] = line.substr(start, end - start);
+        start = end + 1;
+    }
+    size_t end = line.find(Delim, start);
+    out[lastNeeded] = line.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start);
+    return lastNeeded + 1;
+}
+
+// RFC 4180 splitter, used only for rows that contain a '"' so clean rows
+// keep the find()-based fast path. A field that starts with '"' runs to the
+// matching closing quote, may contain delimiters, and "" inside it stands for
+// one quote. Unescaped text is written to `scratch` and out[] points into it.
+// Records are line-based: an unterminated quote ends at the end of the line.
+template <char Delim>
+static void splitQuoted(std::string_view line, size_t maxFields,
+                        std::vector<std::string_view> &out, std::string &scratch)
+{
+    out.clear();
+    scratch.clear();
+    scratch.reserve(line.size()); // never reallocates below, so views stay valid
+
+    size_t i = 0;
+    while (out.size() < maxFields)
+    {
+        size_t fieldStart = scratch.size();
+        if (i < line.size() && line[i] == '"')
+        {
+            i++;
+            while (i < line.size())
+            {
+                if (line[i] == '"')
+                {
+                    if (i + 1 < line.size() && line[i + 1] == '"')
+                    {
+                        scratch.push_back('"');
+                        i += 2;
+                        continue;
+                    }
+                    i++;
+                    break;
+                }
+                scratch.push_back(line[i++]);
+            }
+        }
+        // Unquoted field, or anything trailing a closing quote
+        while (i < line.size() && line[i] != Delim)
+            scratch.push_back(line[i++]);
+
+        out.push_back(std::string_view(scratch).substr(fieldStart));
+        if (i >= line.size())
+            break;
+        i++; // skip the delimiter
+    }
+}
+
+static void finishSchema(CsvSchema &schema)
+{
+    schema.lastRequired = std::max(schema.pickupZone, schema.pickupTime);
+    schema.lastNeeded = schema.lastRequired;
+}
+
+// Positional layouts for files without a recognisable header, picked per
+// row by its column count:
+// Test Files:  [0]ID, [1]Zone, [2]Time                      (Size == 3)
+// Real Files:  [0]ID, [1]Zone, [2]Drop, [3]Time, [4]Dist, [5]Fare (Size >= 4)
+// Optional columns a wide row lacks are simply left empty.
+static CsvSchema positionalSchema(bool wide)
+{
+    CsvSchema schema;
+    if (wide)
+    {
+        schema.dropoffZone = 2;
+        schema.pickupTime = 3;
+        schema.distance = 4;
+        schema.fare = 5;
+    }
+    schema.positional = true;
+    finishSchema(schema);
+    return schema;
+}
+
+// Lowercase and drop everything but letters/digits, so "PickupZoneID",
+// "pickup_zone_id" and "Pickup Zone ID" all compare equal.
+static std::string normalizeColumnName(std::string_view name)
+{
+    std::string out;
+    out.reserve(name.size());
+    for (char c : name)
+    {
+        unsigned char u = static_cast<unsigned char>(c);
+        if (std::isalnum(u))
+            out.push_back(static_cast<char>(std::tolower(u)));
+    }
+    return out;
+}
+
+// The CsvSchema column a header name refers to, or nullptr
+static int CsvSchema::*columnForName(std::string_view name)
+{
+    static const std::unordered_map<std::string, int CsvSchema::*> aliases = {
+        {"tripid", &CsvSchema::tripId},
+        {"id", &CsvSchema::tripId},
+        {"pickupzoneid", &CsvSchema::pickupZone},
+        {"pickupzone", &CsvSchema::pickupZone},
+        {"pulocationid", &CsvSchema::pickupZone},
+        {"dropoffzoneid", &CsvSchema::dropoffZone},
+        {"dropoffzone", &CsvSchema::dropoffZone},
+        {"dolocationid", &CsvSchema::dropoffZone},
+        {"pickuptime", &CsvSchema::pickupTime},
+        {"pickupdatetime", &CsvSchema::pickupTime},
+        {"distance", &CsvSchema::distance},
+        {"tripdistance", &CsvSchema::distance},
+        {"fare", &CsvSchema::fare},
+        {"fareamount", &CsvSchema::fare},
+    };
+    auto it = aliases.find(normalizeColumnName(name));
+    return it == aliases.end() ? nullptr : it->second;
+}
+
+// A first line is a header if it has the 3 columns every row needs and
+// names at least one known column; anything else is data
+static bool looksLikeHeader(const std::vector<std::string_view> &fields)
+{
+    if (fields.size() < 3)
+        return false;
+    for (std::string_view field : fields)
+    {
+        if (columnForName(field))
+            return true;
+    }
+    return false;
+}
+
+// Maps named header columns to indices. Returns false if the pickup zone or
+// pickup time column cannot be found by name.
+static bool schemaFromHeader(const std::vector<std::string_view> &header, CsvSchema &schema)
+{
+    CsvSchema named;
+    named.tripId = named.pickupZone = named.dropoffZone = -1;
+    named.pickupTime = named.distance = named.fare = -1;
+
+    for (size_t i = 0; i < header.size(); ++i)
+    {
+        int CsvSchema::*column = columnForName(header[i]);
+        if (column && named.*column < 0)
+            named.*column = static_cast<int>(i);
+    }
+
+    if (named.pickupZone < 0 || named.pickupTime < 0)
+        return false;
+
+    finishSchema(named);
+    schema = named;
+    return true;
+}
+
+// Hour between the date/time separator and the first ':' after it.
+// Accepts leading whitespace/sign and ignores trailing characters, like
+// std::stoi did. Returns -1 if there are no digits, -2 if out of 0..23.
+static int parseHour(std::string_view hourSub)
+{
+    size_t i = 0;
+    while (i < hourSub.size() && std::isspace(static_cast<unsigned char>(hourSub[i])))
+        i++;
+    bool negative = false;
+    if (i < hourSub.size() && (hourSub[i] == '+' || hourSub[i] == '-'))
+    {
+        negative = hourSub[i] == '-';
+        i++;
+    }
+    size_t digitsStart = i;
+    int value = 0;
+    while (i < hourSub.size() && hourSub[i] >= '0' && hourSub[i] <= '9')
+    {
+        if (value <= 23)
+            value = value * 10 + (hourSub[i] - '0');
+        i++;
+    }
+    if (i == digitsStart)
+        return -1;
+    if (negative && value != 0)
+        return -2;
+    return value > 23 ? -2 : value;
+}
+
+// "YYYY-MM-DD" to days since 1970-01-01, or INT_MIN if malformed. The
+// digits are checked and combined without a branch per character; the
+// calendar conversion is Hinnant's days_from_civil, which is branch-free
+// (the month shifts are comparisons used as 0/1, not jumps).
+static inline int parseDayIndex(std::string_view date)
+{
+    if (date.size() != 10)
+        return INT_MIN;
+    const unsigned char *c = reinterpret_cast<const unsigned char *>(date.data());
+    unsigned d[10];
+    unsigned bad = (c[4] != '-') | (c[7] != '-');
+    for (int i = 0; i < 10; ++i)
+    {
+        d[i] = c[i] - unsigned('0');
+        bad |= (i != 4 && i != 7) & (d[i] > 9);
+    }
+    int y = static_cast<int>(d[0] * 1000 + d[1] * 100 + d[2] * 10 + d[3]);
+    unsigned m = d[5] * 10 + d[6];
+    unsigned dd = d[8] * 10 + d[9];
+    bad |= (m - 1 > 11) | (dd < 1) | (y < 1);
+    if (bad)
+        return INT_MIN;
+    static const unsigned char DaysInMonth[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    bool leap = y % 4 == 0 && (y % 100 != 0 || y % 400 == 0);
+    if (dd > DaysInMonth[m - 1] + unsigned(m == 2 && leap))
+        return INT_MIN;
+
+    y -= m <= 2;
+    int era = y / 400; // y >= 0 here (year 0001 and up)
+    unsigned yoe = static_cast<unsigned>(y - era * 400);
+    unsigned doy = (153 * (m + 9 - 12 * (m > 2)) + 2) / 5 + dd - 1; // March-based
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<int>(doe) - 719468;
+}
+
+// 0 = Monday for a day index (1970-01-01 was a Thursday)
+static inline int weekdayOf(int day)
+{
+    return ((day + 3) % 7 + 7) % 7;
+}
+
+// Inverse of parseDayIndex (Hinnant's civil_from_days), for labels
+static std::string formatDayIndex(int day)
+{
+    int z = day + 719468;
+    int era = (z >= 0 ? z : z - 146096) / 146097;
+    unsigned doe = static_cast<unsigned>(z - era * 146097);
+    unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int y = static_cast<int>(yoe) + era * 400;
+    unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    unsigned mp = (5 * doy + 2) / 153;
+    unsigned d = doy - (153 * mp + 2) / 5 + 1;
+    unsigned m = mp < 10 ? mp + 3 : mp - 9;
+    y += m <= 2;
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%04d-%02u-%02u", y, m, d);
+    return buf;
+}
+
+// Minutes "MM" (first two characters) to 0..59, or -1
+static inline int parseMinutes(std::string_view text)
+{
+    if (text.size() < 2)
+        return -1;
+    unsigned tens = static_cast<unsigned char>(text[0]) - unsigned('0');
+    unsigned ones = static_cast<unsigned char>(text[1]) - unsigned('0');
+    if (tens > 5 || ones > 9)
+        return -1;
+    return static_cast<int>(tens * 10 + ones);
+}
+
+// Up to 8 ASCII digits to their value with SWAR arithmetic: the digits are
+// right-aligned in a '0'-padded 64-bit word, validated all at once, then
+// combined into pairs, quads and the full value in three multiply steps
+// instead of a loop with a branch per digit. False if any byte is not a digit.
+static inline bool parseDigits8(const char *p, size_t n, uint64_t &value)
+{
+    // Shift the digits in from the top: same layout as memcpy into a
+    // '0'-filled buffer at offset 8 - n, without a variable-length memcpy
+    uint64_t v = 0x3030303030303030ULL;
+    for (size_t i = 0; i < n; ++i)
+        v = (v >> 8) | (static_cast<uint64_t>(static_cast<unsigned char>(p[i])) << 56);
+    if ((v & 0xF0F0F0F0F0F0F0F0ULL) != 0x3030303030303030ULL ||
+        ((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) != 0x3030303030303030ULL)
+        return false;
+    v = ((v & 0x0F0F0F0F0F0F0F0FULL) * 2561) >> 8;                // pairs
+    v = ((v & 0x00FF00FF00FF00FFULL) * 6553601) >> 16;             // quads
+    value = ((v & 0x0000FFFF0000FFFFULL) * 42949672960001ULL) >> 32; // all 8
+    return true;
+}
+
+// Decimal "[-]ddd[.ddd]" to fixed-point hundredths, rounding the third
+// decimal half away from zero. No stod, no locale, no exponents; at most
+// 8 integer digits. False if the text is not such a number.
+static inline bool parseHundredths(std::string_view text, long long &out)
+{
+    bool negative = false;
+    if (!text.empty() && (text[0] == '-' || text[0] == '+'))
+    {
+        negative = text[0] == '-';
+        text.remove_prefix(1);
+    }
+    // Short fields: an inline scan beats a memchr call
+    size_t dot = 0;
+    while (dot < text.size() && text[dot] != '.')
+        dot++;
+    std::string_view whole = text.substr(0, dot);
+    std::string_view frac = dot < text.size() ? text.substr(dot + 1) : std::string_view();
+    if ((whole.empty() && frac.empty()) || whole.size() > 8)
+        return false;
+
+    uint64_t intPart = 0;
+    if (!whole.empty() && !parseDigits8(whole.data(), whole.size(), intPart))
+        return false;
+
+    // Keep three decimals for rounding; longer fractions must still be
+    // digits but are otherwise ignored
+    uint64_t fracPart = 0;
+    size_t kept = std::min<size_t>(frac.size(), 3);
+    if (kept && !parseDigits8(frac.data(), kept, fracPart))
+        return false;
+    for (size_t i = kept; i < frac.size(); ++i)
+    {
+        if (frac[i] < '0' || frac[i] > '9')
+            return false;
+    }
+    for (size_t i = kept; i < 3; ++i)
+        fracPart *= 10;
+
+    long long value = static_cast<long long>(intPart * 100 + (fracPart + 5) / 10);
+    out = negative ? -value : value;
+    return true;
+}
+
+// One data row reduced to what the aggregator needs
+struct ParsedRow
+{
+    std::string_view zone;
+    int hour;
+    // Optional columns; empty when the row lacks them or they lie past
+    // the projection (see TripAnalyzer::projectSchema)
+    std::string_view tripId;
+    std::string_view dropoff;
+    std::string_view distance;
+    std::string_view fare;
+    // Rest of the timestamp: text before the date/time separator and
+    // after the hour's colon, for the time-bucket aggregates
+    std::string_view date;
+    std::string_view minutes;
+};
+
+// Per-file buffers reused by the row parser
+struct RowScratch
+{
+    std::vector<std::string_view> fields;
+    std::vector<std::string_view> quotedFields;
+    std::string quoted;
+};
+
+// Row parser specialised on the delimiter and the date/time separator, so
+// each profile gets its own inlined inner loop with the separators as
+// constants. Returns RejectReason::Count if the row was accepted.
+template <char Delim, char DateTimeSep>
+static inline RejectReason parseRow(std::string_view line, const CsvSchema &schema,
+                                    RowScratch &scratch, ParsedRow &out, [[maybe_unused]] StageProbe &probe)
+{
+    // 1. Split only up to the last column we need
+    const std::string_view *row;
+    int columns;
+    if (line.find('"') == std::string_view::npos)
+    {
+        columns = splitFields<Delim>(line, schema.lastNeeded, scratch.fields.data());
+        row = scratch.fields.data();
+    }
+    else
+    {
+        splitQuoted<Delim>(line, schema.lastNeeded + 1, scratch.quotedFields, scratch.quoted);
+        columns = static_cast<int>(scratch.quotedFields.size());
+        row = scratch.quotedFields.data();
+    }
+    if (columns <= schema.lastRequired)
+        return RejectReason::TooFewColumns;
+    TRIP_PROBE_CHARGE(probe, tokenize);
+
+    // 2. Extract Zone
+    out.zone = trim(row[schema.pickupZone]);
+    if (out.zone.empty())
+        return RejectReason::EmptyZone;
+
+    // NOTE: Do NOT normalize case. Test B3 requires "zone" != "ZONE".
+
+    // 3. Extract Timestamp
+    std::string_view dateStr = trim(row[schema.pickupTime]);
+    if (dateStr.empty())
+        return RejectReason::EmptyTime;
+
+    // 4. Parse Hour
+    // Format: "YYYY-MM-DD HH:MM" (or "YYYY-MM-DDTHH:MM" for ISO profiles)
+    // We find the separator then the colon ':' to locate the hour.
+    size_t sepPos = dateStr.find(DateTimeSep);
+    if (sepPos == std::string_view::npos)
+        return RejectReason::NoSpace;
+
+    size_t colonPos = dateStr.find(':', sepPos);
+    if (colonPos == std::string_view::npos)
+        return RejectReason::NoColon;
+
+    // Hour is between separator and colon
+    out.hour = parseHour(dateStr.substr(sepPos + 1, colonPos - (sepPos + 1)));
+    if (out.hour == -1)
+        return RejectReason::NonNumericHour;
+    if (out.hour < 0)
+        return RejectReason::HourOutOfRange;
+    out.date = dateStr.substr(0, sepPos);
+    out.minutes = dateStr.substr(colonPos + 1);
+
+    // 5. Optional columns, only when projected and present in this row
+    out.tripId = schema.tripId >= 0 && schema.tripId < columns ? trim(row[schema.tripId]) : std::string_view();
+    out.dropoff = schema.dropoffZone >= 0 && schema.dropoffZone < columns ? trim(row[schema.dropoffZone]) : std::string_view();
+    out.distance = schema.distance >= 0 && schema.distance < columns ? trim(row[schema.distance]) : std::string_view();
+    out.fare = schema.fare >= 0 && schema.fare < columns ? trim(row[schema.fare]) : std::string_view();
+
+    TRIP_PROBE_CHARGE(probe, timestamp);
+    return RejectReason::Count;
+}
+
+// Picks whichever of , ; and TAB occurs most often in the first line
+static Delimiter sniffDelimiter(std::string_view firstLine)
+{
+    long long commas = std::count(firstLine.begin(), firstLine.end(), ',');
+    long long semicolons = std::count(firstLine.begin(), firstLine.end(), ';');
+    long long tabs = std::count(firstLine.begin(), firstLine.end(), '\t');
+    if (semicolons > commas && semicolons >= tabs)
+        return Delimiter::Semicolon;
+    if (tabs > commas && tabs > semicolons)
+        return Delimiter::Tab;
+    return Delimiter::Comma;
+}
+
+const char *rejectReasonName(RejectReason reason)
+{
+    switch (reason)
+    {
+    case RejectReason::TooFewColumns:
+        return "too_few_columns";
+    case RejectReason::EmptyZone:
+        return "empty_zone";
+    case RejectReason::EmptyTime:
+        return "empty_time";
+    case RejectReason::NoSpace:
+        return "no_space";
+    case RejectReason::NoColon:
+        return "no_colon";
+    case RejectReason::NonNumericHour:
+        return "non_numeric_hour";
+    case RejectReason::HourOutOfRange:
+        return "hour_out_of_range";
+    default:
+        return "unknown";
+    }
+}
+
+long long IngestStats::rejectedTotal() const
 {
-    std::ifstream file(csvPath);
-    if (!file.is_open())
+    long long total = 0;
+    for (long long n : rejects)
+        total += n;
+    return total;
+}
+
+// Reservoir sampling (Algorithm R) over rejected lines. Only reached on the
+// reject path, and only when a sample size is set.
+void TripAnalyzer::sampleReject(RejectReason reason, long long lineNumber, std::string_view line)
+{
+    long long seen = _stats.rejectedTotal();
+    std::vector<RejectedLine> &sample = _stats.rejectSample;
+    if (sample.size() < _rejectSampleSize)
+    {
+        sample.push_back({lineNumber, reason, std::string(line)});
         return;
+    }
+    // xorshift64*: deterministic across runs, good enough for sampling
+    _rejectRng ^= _rejectRng >> 12;
+    _rejectRng ^= _rejectRng << 25;
+    _rejectRng ^= _rejectRng >> 27;
+    unsigned long long j = (_rejectRng * 2685821657736338717ULL) % static_cast<unsigned long long>(seen);
+    if (j < _rejectSampleSize)
+        sample[j] = {lineNumber, reason, std::string(line)};
+}
 
-    std::string line;
-    bool firstLine = true;
-    std::vector<std::string> tokens;
-    tokens.reserve(16);
+// Widens the split to the optional columns the enabled features read
+void TripAnalyzer::projectSchema(CsvSchema &schema) const
+{
+    int last = schema.lastRequired;
+    if (!_approxCapacity)
+        last = std::max(last, schema.dropoffZone); // dropoff and route counts
+    if (_fareStats && !_approxCapacity)
+        last = std::max({last, schema.distance, schema.fare});
+    if (_dedup.enabled())
+        last = std::max(last, schema.tripId);
+    if (_distinctPrecision)
+        last = std::max({last, schema.tripId, schema.dropoffZone});
+    schema.lastNeeded = last;
+}
 
-    while (std::getline(file, line))
+// Sizes the per-zone arrays for every id interned so far, doubling so a
+// stream of new zones costs amortised O(1)
+void TripAnalyzer::growZoneArrays()
+{
+    size_t n = std::max<size_t>(_zones.size(), _pickupCounts.size() * 2);
+    _pickupCounts.resize(n, 0);
+    _hourlyCounts.resize(n * 24, 0);
+    _dropoffCounts.resize(n, 0);
+    if (_timeBuckets)
     {
-        if (line.empty())
-            continue;
+        _quarterCounts.resize(n * 96, 0);
+        _weekdayCounts.resize(n * 7, 0);
+    }
+    if (_fareStats)
+    {
+        _zoneFare.resize(n);
+        _zoneDistance.resize(n);
+        _slotFare.resize(n * 24);
+        _slotDistance.resize(n * 24);
+    }
+}
+
+// Count-Min key for a (zone, hour) slot: the hour picks the hash seed
+static inline uint64_t slotHash(std::string_view zone, int hour)
+{
+    return sketchHash(zone, static_cast<uint64_t>(hour) + 1);
+}
 
-        tokens.clear();
-        size_t start = 0;
-        size_t end = line.find(',');
+// Splits the reader's chunks into lines (stitching lines that span two
+// chunks) and runs each through the profile's specialised row parser.
+// `chunk` is the first chunk, already fetched to pick the profile.
+template <char Delim, char DateTimeSep>
+void TripAnalyzer::ingestChunks(ChunkReader &reader, std::string_view chunk, ScanState &scan)
+{
+    bool &firstLine = scan.firstLine;
+    bool &schemaResolved = scan.schemaResolved;
+    long long lineNumber = 0;
+    std::vector<std::string_view> header;
+    std::string headerScratch;
+    RowScratch scratch;
+    ParsedRow parsed;
+    StageProbe probe;
+    TRIP_PROBE_RESET(probe);
+    std::string slotKey; // approximate mode: zone bytes + one hour byte
+    if (schemaResolved)
+        scratch.fields.resize(_schema.lastNeeded + 1);
 
-        while (end != std::string::npos)
-        {
-            tokens.push_back(line.substr(start, end - start));
-            start = end + 1;
-            end = line.find(',', start);
-        }
-        tokens.push_back(line.substr(start));
+    // Positional files: a row too short for the wide layout is read with
+    // the 3-column one, so each row gets the layout of its column count
+    CsvSchema narrow = positionalSchema(false);
+    projectSchema(narrow);
+    auto parse = [&](std::string_view line)
+    {
+        RejectReason reason = parseRow<Delim, DateTimeSep>(line, _schema, scratch, parsed, probe);
+        if (reason == RejectReason::TooFewColumns && _schema.positional)
+            reason = parseRow<Delim, DateTimeSep>(line, narrow, scratch, parsed, probe);
+        return reason;
+    };
 
-        // 1. Validation: Need at least 3 columns for the Test files.
-        //    (Real data has 6, but we accept 3 to pass the unit tests)
-        if (tokens.size() < 3)
-            continue;
+    auto reject = [&](RejectReason reason, std::string_view line)
+    {
+        // Plain counter bump; the sample is only touched when enabled
+        _stats.rejects[static_cast<int>(reason)]++;
+        if (_rejectSampleSize)
+            sampleReject(reason, lineNumber, line);
+    };
 
-        // 2. Skip Header
-        // Heuristic: If first token is not a digit, assume it's a header
-        if (firstLine)
+    // Dropoff side and OD pair of a row whose pickup zone is `zone`
+    auto countDropoff = [&](uint32_t zone, std::string_view dropoffZone)
+    {
+        uint32_t dropoff = _zones.intern(dropoffZone);
+        if (std::max(zone, dropoff) >= _dropoffCounts.size())
+            growZoneArrays();
+        _dropoffCounts[dropoff]++;
+        _routeCounts.add(zone, dropoff);
+    };
+
+    // 5. Aggregate an accepted row
+    auto aggregate = [&](const ParsedRow &parsed)
+    {
+        if (_slotSketch.enabled())
+            _slotSketch.add(slotHash(parsed.zone, parsed.hour));
+        if (_distinctPrecision)
         {
-            firstLine = false;
-            std::string firstTok = trim(tokens[0]);
-            if (firstTok.empty() || !std::isdigit(static_cast<unsigned char>(firstTok[0])))
+            if (!parsed.tripId.empty())
             {
-                continue;
+                _tripIdHll.add(sketchHash(parsed.tripId));
+                _distinctRows++;
             }
+            if (!parsed.dropoff.empty())
+            {
+                auto it = _dropoffHll.find(std::string(parsed.zone));
+                if (it == _dropoffHll.end())
+                    it = _dropoffHll.emplace(std::string(parsed.zone), HyperLogLog(_distinctPrecision)).first;
+                it->second.add(sketchHash(parsed.dropoff));
+            }
+        }
+        if (_approxCapacity)
+        {
+            // Bounded memory: Space-Saving summaries instead of exact maps
+            _approxZones.add(parsed.zone);
+            slotKey.assign(parsed.zone.data(), parsed.zone.size());
+            slotKey.push_back(static_cast<char>(parsed.hour));
+            _approxSlots.add(slotKey);
+            _stats.rowsAccepted++;
+            TRIP_PROBE_CHARGE(probe, aggregate);
+            return;
         }
 
-        // 3. Extract Zone
-        // Index 1: PickupZoneID (Consistent in both formats)
-        std::string zone = trim(tokens[1]);
-        if (zone.empty())
-            continue;
+        // Parallel worker in shared-table mode: pickup and hour go to the
+        // shared table, the dropoff side and route to this shard
+        if (_sharedZones && _sharedZones->add(parsed.zone, parsed.hour))
+        {
+            if (!parsed.dropoff.empty())
+                countDropoff(_zones.intern(parsed.zone), parsed.dropoff);
+            _stats.rowsAccepted++;
+            TRIP_PROBE_CHARGE(probe, aggregate);
+            return;
+        }
 
-        // NOTE: Do NOT normalize case. Test B3 requires "zone" != "ZONE".
+        uint32_t zone = _zones.intern(parsed.zone);
+        if (zone >= _pickupCounts.size())
+            growZoneArrays();
+        _pickupCounts[zone]++;
+        _hourlyCounts[static_cast<size_t>(zone) * 24 + parsed.hour]++;
 
-        // 4. Extract Timestamp (DYNAMIC LOGIC)
-        // Test Files:  [0]ID, [1]Zone, [2]Time        (Size == 3)
-        // Real Files:  [0]ID, [1]Zone, [2]Drop, [3]Time (Size >= 4)
-        std::string dateStr;
-        if (tokens.size() == 3)
+        if (_fareStats)
         {
-            dateStr = trim(tokens[2]);
+            size_t slot = static_cast<size_t>(zone) * 24 + parsed.hour;
+            long long value;
+            if (!parsed.fare.empty() && parseHundredths(parsed.fare, value))
+            {
+                _zoneFare.add(zone, value);
+                _slotFare.add(slot, value);
+            }
+            if (!parsed.distance.empty() && parseHundredths(parsed.distance, value))
+            {
+                _zoneDistance.add(zone, value);
+                _slotDistance.add(slot, value);
+            }
         }
-        else
+
+        if (_timeBuckets)
         {
-            // Safety check for larger files
-            if (tokens.size() > 3)
-                dateStr = trim(tokens[3]);
-            else
-                continue;
+            int minutes = parseMinutes(parsed.minutes);
+            if (minutes >= 0)
+                _quarterCounts[static_cast<size_t>(zone) * 96 + parsed.hour * 4 + minutes / 15]++;
+        }
+        if (_timeBuckets || _dailyIndex)
+        {
+            int day = parseDayIndex(parsed.date);
+            if (day != INT_MIN)
+            {
+                if (_timeBuckets)
+                    _weekdayCounts[static_cast<size_t>(zone) * 7 + weekdayOf(day)]++;
+                _dayCounts.add(zone, static_cast<uint32_t>(day));
+            }
         }
 
-        if (dateStr.empty())
-            continue;
+        // Dropoff side and OD pairs, when the file has a dropoff column
+        if (!parsed.dropoff.empty())
+            countDropoff(zone, parsed.dropoff);
+        _stats.rowsAccepted++;
+        TRIP_PROBE_CHARGE(probe, aggregate);
+    };
+
+    // Rows whose trip ID hit the dedup filter: dedup log position and text
+    struct HeldRow
+    {
+        size_t logPos;
+        std::string line;
+    };
+    std::vector<HeldRow> heldBack;
+    size_t heldBytes = 0;
+
+    // Settles the held-back rows against the dedup log: true
+    // repeats are dropped, filter false positives counted as usual. Runs
+    // whenever the held text reaches HeldBackBytes, and at the end of the
+    // file. A batch only looks at earlier log entries, so settling early
+    // gives the same result. The dedup index carries over between batches,
+    // so each batch only indexes the keys logged since the previous one.
+    const size_t HeldBackBytes = size_t(32) << 20;
+    auto settleHeldBack = [&]()
+    {
+        std::vector<size_t> positions;
+        positions.reserve(heldBack.size());
+        for (const HeldRow &row : heldBack)
+            positions.push_back(row.logPos);
+        std::vector<bool> duplicate = _dedup.resolve(positions);
+        for (size_t i = 0; i < heldBack.size(); ++i)
+        {
+            if (duplicate[i])
+            {
+                _stats.duplicateRows++;
+                continue;
+            }
+            _stats.dedupFalsePositives++;
+            parse(heldBack[i].line);
+            aggregate(parsed);
+        }
+        heldBack.clear();
+        heldBytes = 0;
+    };
 
-        // 5. Parse Hour
-        // Format: "YYYY-MM-DD HH:MM"
-        // We find the space ' ' then the colon ':' to locate the hour.
-        size_t spacePos = dateStr.find(' ');
-        if (spacePos == std::string::npos)
-            continue;
+    // Snapshot publishing: the clock is read once every SnapshotCheckLines
+    // lines, so the per-line cost is one counter decrement
+    const int SnapshotCheckLines = 65536;
+    int untilSnapshotCheck = SnapshotCheckLines;
+    auto lastSnapshot = std::chrono::steady_clock::now();
+    auto maybePublish = [&]()
+    {
+        untilSnapshotCheck = SnapshotCheckLines;
+        auto now = std::chrono::steady_clock::now();
+        if (std::chrono::duration_cast<std::chrono::nanoseconds>(now - lastSnapshot).count() < _snapshotGapNanos)
+            return;
+        publishSnapshot(false);
+        lastSnapshot = std::chrono::steady_clock::now();
+    };
 
-        size_t colonPos = dateStr.find(':', spacePos);
-        if (colonPos == std::string::npos)
-            continue;
+    // Memory budget: checked every SpillCheckLines lines, against the
+    // growth those lines could cause
+    const int SpillCheckLines = 4096;
+    int untilSpillCheck = SpillCheckLines;
+    bool budget = spillEnabled();
 
-        // Hour is between space and colon
-        std::string hourSub = dateStr.substr(spacePos + 1, colonPos - (spacePos + 1));
+    auto processLine = [&](std::string_view line)
+    {
+        TRIP_PROBE_CHARGE(probe, tokenize); // finding the line end
+        lineNumber++;
+        if (line.empty())
+        {
+            _stats.blankLines++;
+            return;
+        }
 
-        int hour = -1;
-        try
+        // 1. Header / schema detection (once per file): the first line is
+        // a header only if it names a known column (see looksLikeHeader)
+        if (firstLine)
         {
-            hour = std::stoi(hourSub);
+            firstLine = false;
+            splitQuoted<Delim>(line, SIZE_MAX, header, headerScratch);
+            if (looksLikeHeader(header))
+            {
+                schemaResolved = schemaFromHeader(header, _schema);
+                projectSchema(_schema);
+                scratch.fields.resize(_schema.lastNeeded + 1);
+                _stats.headerRows++;
+                return;
+            }
         }
-        catch (...)
+
+        // Headerless, or the header lacks pickup zone or time: positional
+        // layouts, picked per row
+        if (!schemaResolved)
         {
-            continue; // Handles "NOT_A_TIME"
+            _schema = positionalSchema(true);
+            schemaResolved = true;
+            projectSchema(_schema);
+            scratch.fields.resize(_schema.lastNeeded + 1);
         }
 
-        if (hour < 0 || hour > 23)
-            continue;
+        RejectReason reason = parse(line);
+        if (reason != RejectReason::Count)
+            return reject(reason, line);
 
-        // 6. Aggregate
-        _zoneCounts[zone]++;
+        // Trip ID dedup: a filter hit holds the row back until the batch
+        // is settled, when it is either dropped or counted after all
+        if (_dedup.enabled() && !parsed.tripId.empty())
+        {
+            bool suspect;
+            size_t logPos = _dedup.insert(parsed.tripId, suspect);
+            if (suspect)
+            {
+                heldBack.push_back({logPos, std::string(line)});
+                heldBytes += sizeof(HeldRow) + line.size();
+                if (heldBytes >= HeldBackBytes)
+                    settleHeldBack();
+                return;
+            }
+        }
+        aggregate(parsed);
+    };
+    // Tail of the previous chunk that had no newline yet
+    std::string carry;
+    while (!chunk.empty())
+    {
+        size_t pos = 0;
+        if (!carry.empty())
+        {
+            size_t nl = chunk.find('\n');
+            if (nl == std::string_view::npos)
+            {
+                carry.append(chunk);
+                chunk = reader.next();
+                TRIP_PROBE_RESET(probe); // read time is reported by the reader
+                continue;
+            }
+            carry.append(chunk.substr(0, nl));
+            processLine(carry);
+            carry.clear();
+            pos = nl + 1;
+        }
 
-        if (_zoneHourlyCounts.find(zone) == _zoneHourlyCounts.end())
+        for (;;)
         {
-            _zoneHourlyCounts[zone] = std::vector<long long>(24, 0);
+            size_t nl = chunk.find('\n', pos);
+            if (nl == std::string_view::npos)
+            {
+                carry.assign(chunk.substr(pos));
+                break;
+            }
+            processLine(chunk.substr(pos, nl - pos));
+            pos = nl + 1;
+            if (_snapshotIntervalMs && --untilSnapshotCheck == 0)
+                maybePublish();
+            if (budget && --untilSpillCheck == 0)
+            {
+                untilSpillCheck = SpillCheckLines;
+                if (aggregateBytes(SpillCheckLines) > _memoryBudget)
+                    budget = spillAggregates(); // off if the files failed
+            }
         }
-        _zoneHourlyCounts[zone][hour]++;
+        chunk = reader.next();
+        TRIP_PROBE_RESET(probe);
+    }
+    if (!carry.empty())
+        processLine(carry);
+
+    if (!heldBack.empty())
+        settleHeldBack();
+
+    _routeCounts.flush();
+    _dayCounts.flush();
+    _stats.linesRead += lineNumber;
+
+#ifdef TRIP_INSTRUMENT
+    // Ticks until ingestFile converts them; a shard adds up its ranges
+    _timings.tokenizeNanos += static_cast<long long>(probe.tokenize);
+    _timings.timestampNanos += static_cast<long long>(probe.timestamp);
+    _timings.aggregateNanos += static_cast<long long>(probe.aggregate);
+#endif
+}
+
+// Reads nothing: ingestChunks over a range that is already in memory
+class NoMoreChunks : public ChunkReader
+{
+public:
+    std::string_view next() override { return {}; }
+    ReadTiming timing() const override { return {}; }
+};
+
+template <char Delim, char DateTimeSep>
+void TripAnalyzer::ingestText(ChunkReader &reader, std::string_view chunk, bool parallel)
+{
+    if (parallel)
+    {
+        ingestParallel<Delim, DateTimeSep>(chunk);
+        return;
     }
+    ScanState scan;
+    ingestChunks<Delim, DateTimeSep>(reader, chunk, scan);
 }
 
-std::vector<ZoneCount> TripAnalyzer::topZones(int k) const
+// Distinct zones in the first range of a file at which parallel ingest
+// (ZoneTableMode::Auto) switches to the shared zone table. About 8k zones
+// in ~1 MB means per-worker tables would each end up holding most of a
+// very large zone set.
+static const size_t SharedTableZones = 8192;
+
+// `text` is the whole file. The header and the first TaskBytes range are
+// parsed here, which also samples the zone cardinality; the rest is cut
+// at line ends into TaskBytes ranges for the pool's workers, which parse
+// them into one shard each (plus the shared zone table, in shared mode).
+template <char Delim, char DateTimeSep>
+void TripAnalyzer::ingestParallel(std::string_view text)
 {
-    std::vector<ZoneCount> results;
-    results.reserve(_zoneCounts.size());
+    NoMoreChunks none;
+    ScanState scan;
+    size_t pos = 0;
+    while (!scan.schemaResolved && pos < text.size())
+    {
+        size_t nl = text.find('\n', pos);
+        size_t end = nl == std::string_view::npos ? text.size() : nl + 1;
+        ingestChunks<Delim, DateTimeSep>(none, text.substr(pos, end - pos), scan);
+        pos = end;
+    }
 
-    for (const auto &kv : _zoneCounts)
+    const size_t TaskBytes = 1 << 20;
+    std::vector<std::string_view> ranges;
+    while (pos < text.size())
     {
-        ZoneCount z;
-        z.zone = kv.first;
-        z.count = kv.second;
-        results.push_back(z);
+        size_t end = std::min(text.size(), pos + TaskBytes);
+        size_t nl = end < text.size() ? text.find('\n', end) : std::string_view::npos;
+        end = nl == std::string_view::npos ? text.size() : nl + 1;
+        ranges.push_back(text.substr(pos, end - pos));
+        pos = end;
     }
+    if (ranges.empty())
+        return;
+    ingestChunks<Delim, DateTimeSep>(none, ranges[0], scan);
 
-    // Sort: Count DESC, Zone ASC
-    std::sort(results.begin(), results.end(), [](const ZoneCount &a, const ZoneCount &b)
-              {
-        if (a.count != b.count) {
-            return a.count > b.count; 
+    // Shared table when nothing per pickup zone is kept beyond its count
+    // and hourly counts (dropoff zones and routes stay in the shards), and
+    // (in Auto) the sample has many zones
+    bool pickupOnly = !_fareStats && !_timeBuckets && !_dailyIndex;
+    bool shared = pickupOnly && (_zoneTableMode == ZoneTableMode::Shared ||
+                                 (_zoneTableMode == ZoneTableMode::Auto && _zones.size() >= SharedTableZones));
+    std::unique_ptr<SharedZoneCounts> sharedZones;
+    if (shared)
+        sharedZones.reset(new SharedZoneCounts(std::max<size_t>(size_t(1) << 16, _zones.size() * 8)));
+    _stats.sharedZoneTable = shared;
+
+    // Each shard is created by its worker on first use, so its tables are
+    // allocated and first touched on the worker's NUMA node
+    std::vector<std::unique_ptr<TripAnalyzer>> shards(_pool->size());
+    auto shardOf = [&](int worker) -> TripAnalyzer &
+    {
+        std::unique_ptr<TripAnalyzer> &shard = shards[worker];
+        if (!shard)
+        {
+            shard.reset(new TripAnalyzer);
+            shard->_profile = _profile;
+            shard->_schema = _schema;
+            shard->_fareStats = _fareStats;
+            shard->_timeBuckets = _timeBuckets;
+            shard->_dailyIndex = _dailyIndex;
+            shard->_sharedZones = sharedZones.get();
         }
-        return a.zone < b.zone; });
+        return *shard;
+    };
 
-    if (k >= 0 && (size_t)k < results.size())
+    // The shared table cannot grow while workers insert, so it is fed in
+    // waves and doubled in between when more than half full. Zones that
+    // still do not fit go to the worker's shard.
+    size_t wave = shared ? static_cast<size_t>(_pool->size()) * 8 : ranges.size();
+    for (size_t first = 1; first < ranges.size(); first += wave)
     {
-        results.resize(k);
+        if (shared && sharedZones->size() * 2 > sharedZones->capacity())
+            sharedZones->reserve(sharedZones->capacity() * 2);
+        _pool->run(std::min(wave, ranges.size() - first), [&](int worker, size_t index)
+                   {
+            NoMoreChunks end;
+            ScanState known;
+            known.firstLine = false;
+            known.schemaResolved = true;
+            shardOf(worker).template ingestChunks<Delim, DateTimeSep>(end, ranges[first + index], known); });
+    }
+
+    // On several nodes, each node's first worker folds the node's other
+    // shards into its own while still on that node, so only one shard per
+    // node crosses the interconnect in the final merge
+    if (_pool->nodes() > 1)
+    {
+        _pool->run(shards.size(), [&](int, size_t index)
+                   {
+            int leader = static_cast<int>(index);
+            if (leader > 0 && _pool->nodeOf(leader - 1) == _pool->nodeOf(leader))
+                return;
+            for (int w = leader + 1; w < _pool->size() && _pool->nodeOf(w) == _pool->nodeOf(leader); ++w)
+            {
+                if (!shards[w])
+                    continue;
+                if (!shards[leader])
+                    shards[leader] = std::move(shards[w]);
+                else
+                    shards[leader]->mergeShard(*shards[w]);
+                shards[w].reset();
+            } }, true);
+    }
+
+    if (shared)
+        mergeSharedZones(*sharedZones);
+    for (const std::unique_ptr<TripAnalyzer> &shard : shards)
+    {
+        if (shard)
+            mergeShard(*shard);
     }
-    return results;
 }
 
-std::vector<SlotCount> TripAnalyzer::topBusySlots(int k) const
+bool TripAnalyzer::parallelIngest() const
 {
-    std::vector<SlotCount> results;
-    results.reserve(_zoneHourlyCounts.size() * 5);
+    return _pool && !_approxCapacity && !_dedup.enabled() && !_rejectSampleSize && !_distinctPrecision &&
+           !_slotSketch.enabled() && !_memoryBudget;
+}
 
-    for (const auto &pair : _zoneHourlyCounts)
-    {
-        const std::string &zone = pair.first;
-        const std::vector<long long> &hours = pair.second;
+void TripAnalyzer::setThreads(int threads)
+{
+    if (threads <= 1)
+        _pool.reset();
+    else if (!_pool || _pool->size() != threads)
+        _pool.reset(new WorkStealingPool(threads));
+}
 
-        for (int h = 0; h < 24; ++h)
+void TripAnalyzer::setThreads(int threads, const NumaTopology &topology)
+{
+    if (threads <= 1)
+        _pool.reset();
+    else
+        _pool.reset(new WorkStealingPool(threads, topology));
+}
+
+std::vector<WorkerStats> TripAnalyzer::workerStats() const
+{
+    return _pool ? _pool->stats() : std::vector<WorkerStats>();
+}
+
+// Adds a shard's exact aggregates and row counts into this analyzer. Zone
+// ids are remapped by name; the per-id arrays are then folded in id blocks
+// on the pool, since a shard's ids map to distinct ids here.
+void TripAnalyzer::mergeShard(const TripAnalyzer &shard)
+{
+    size_t zones = shard._zones.size();
+    std::vector<uint32_t> ids(zones);
+    for (uint32_t id = 0; id < zones; ++id)
+        ids[id] = _zones.intern(shard._zones.name(id));
+    if (_zones.size() > _pickupCounts.size())
+        growZoneArrays();
+
+    auto mergeIds = [&](size_t begin, size_t end)
+    {
+        for (size_t id = begin; id < end; ++id)
         {
-            if (hours[h] > 0)
+            size_t to = ids[id];
+            _pickupCounts[to] += shard._pickupCounts[id];
+            _dropoffCounts[to] += shard._dropoffCounts[id];
+            for (int h = 0; h < 24; ++h)
+                _hourlyCounts[to * 24 + h] += shard._hourlyCounts[id * 24 + h];
+            if (_timeBuckets)
+            {
+                for (int q = 0; q < 96; ++q)
+                    _quarterCounts[to * 96 + q] += shard._quarterCounts[id * 96 + q];
+                for (int d = 0; d < 7; ++d)
+                    _weekdayCounts[to * 7 + d] += shard._weekdayCounts[id * 7 + d];
+            }
+            if (_fareStats)
             {
-                SlotCount s;
-                s.zone = zone;
-                s.hour = h;
-                s.count = hours[h];
-                results.push_back(s);
+                _zoneFare.merge(to, shard._zoneFare, id);
+                _zoneDistance.merge(to, shard._zoneDistance, id);
+                for (int h = 0; h < 24; ++h)
+                {
+                    _slotFare.merge(to * 24 + h, shard._slotFare, id * 24 + h);
+                    _slotDistance.merge(to * 24 + h, shard._slotDistance, id * 24 + h);
+                }
             }
         }
-    }
+    };
+    const size_t MergeBlock = 16384;
+    if (zones <= MergeBlock || !_pool) // shards merging into shards have no pool
+        mergeIds(0, zones);
+    else
+        _pool->run((zones + MergeBlock - 1) / MergeBlock, [&](int, size_t block)
+                   { mergeIds(block * MergeBlock, std::min(zones, (block + 1) * MergeBlock)); });
 
-    // Sort: Count DESC, Zone ASC, Hour ASC
-    std::sort(results.begin(), results.end(), [](const SlotCount &a, const SlotCount &b)
-              {
-        if (a.count != b.count) {
-            return a.count > b.count; 
-        }
-        if (a.zone != b.zone) {
-            return a.zone < b.zone;   
-        }
-        return a.hour < b.hour; });
+    shard._routeCounts.forEach([&](uint32_t pickup, uint32_t dropoff, long long count)
+                               { _routeCounts.add(ids[pickup], ids[dropoff], count); });
+    shard._dayCounts.forEach([&](uint32_t zone, uint32_t day, long long count)
+                             { _dayCounts.add(ids[zone], day, count); });
 
-    if (k >= 0 && (size_t)k < results.size())
+    _stats.linesRead += shard._stats.linesRead;
+    _stats.headerRows += shard._stats.headerRows;
+    _stats.blankLines += shard._stats.blankLines;
+    _stats.rowsAccepted += shard._stats.rowsAccepted;
+    for (int r = 0; r < static_cast<int>(RejectReason::Count); ++r)
+        _stats.rejects[r] += shard._stats.rejects[r];
+#ifdef TRIP_INSTRUMENT
+    // Stage ticks summed over workers, so they can exceed the wall time
+    _timings.tokenizeNanos += shard._timings.tokenizeNanos;
+    _timings.timestampNanos += shard._timings.timestampNanos;
+    _timings.aggregateNanos += shard._timings.aggregateNanos;
+#endif
+}
+
+// Adds the shared table's pickup and hourly counts, by zone name
+void TripAnalyzer::mergeSharedZones(const SharedZoneCounts &shared)
+{
+    size_t zones = shared.size();
+    std::vector<uint32_t> ids(zones);
+    for (uint32_t id = 0; id < zones; ++id)
+        ids[id] = _zones.intern(shared.name(id));
+    if (_zones.size() > _pickupCounts.size())
+        growZoneArrays();
+
+    auto mergeIds = [&](size_t begin, size_t end)
     {
-        results.resize(k);
-    }
-    return results;
+        for (size_t id = begin; id < end; ++id)
+        {
+            size_t to = ids[id];
+            _pickupCounts[to] += shared.count(static_cast<uint32_t>(id));
+            for (int h = 0; h < 24; ++h)
+                _hourlyCounts[to * 24 + h] += shared.hourly(static_cast<uint32_t>(id), h);
+        }
+    };
+    const size_t MergeBlock = 16384;
+    _pool->run((zones + MergeBlock - 1) / MergeBlock, [&](int, size_t block)
+               { mergeIds(block * MergeBlock, std::min(zones, (block + 1) * MergeBlock)); });
+}
+
+void TripAnalyzer::setMemoryBudget(size_t bytes, const std::string &spillDirectory)
+{
+    _memoryBudget = bytes;
+    _spillDirectory = spillDirectory;
+    _spillFailed = false;
+}
+
+// The spill records carry pickup, dropoff, hourly and route counts only
+bool TripAnalyzer::spillEnabled() const
+{
+    return _memoryBudget && !_approxCapacity && !_fareStats && !_timeBuckets && !_dailyIndex;
+}
+
+// Approximate bytes of the exact aggregates after `rows` more rows, each
+// adding at most two zones and one route, including any table or array
+// growth that would trigger
+size_t TripAnalyzer::aggregateBytes(size_t rows) const
+{
+    size_t zones = _zones.size() + 2 * rows;
+    size_t cells = _pickupCounts.size();
+    if (zones > cells)
+        cells = std::max(zones, cells * 2);
+    const size_t ZoneBytes = sizeof(long long) * (1 + 24 + 1); // pickup, hourly, dropoff
+    return _zones.memoryBytes(2 * rows) + cells * ZoneBytes + _routeCounts.memoryBytes(rows) +
+           _hourMajor.capacity() * sizeof(long long);
+}
+
+void TripAnalyzer::residentZone(uint32_t id, SpilledZone &out) const
+{
+    out.zone = _zones.name(id);
+    out.pickups = _pickupCounts[id];
+    out.dropoffs = _dropoffCounts[id];
+    std::copy(&_hourlyCounts[static_cast<size_t>(id) * 24], &_hourlyCounts[static_cast<size_t>(id) * 24] + 24,
+              out.hourly);
+}
+
+// Writes the in-memory zone and route counts to the spill files and frees
+// them. False (everything still in memory) if the files cannot be
+// created or written; the budget is then given up for good.
+bool TripAnalyzer::spillAggregates()
+{
+    if (_spillFailed)
+        return false;
+    if (!_spill)
+    {
+        std::unique_ptr<SpillStore> store(new SpillStore(_spillDirectory));
+        // Merging a partition costs a few times its file bytes in memory
+        store->setPartitionBytes(static_cast<long long>(_memoryBudget / 8));
+        if (!store->open())
+        {
+            _spillFailed = true;
+            return false;
+        }
+        _spill = std::move(store);
+    }
+
+    _routeCounts.flush();
+    _spill->beginBatch();
+    SpilledZone zone;
+    for (uint32_t id = 0; id < _zones.size(); ++id)
+    {
+        residentZone(id, zone);
+        _spill->add(zone);
+    }
+    SpilledRoute route;
+    _routeCounts.forEach([&](uint32_t pickup, uint32_t dropoff, long long count)
+                         {
+        route.pickupZone = _zones.name(pickup);
+        route.dropoffZone = _zones.name(dropoff);
+        route.count = count;
+        _spill->add(route); });
+    if (!_spill->commitBatch())
+    {
+        _spillFailed = true;
+        return false;
+    }
+
+    // Swap with empty containers: clear() would keep the capacity
+    _zones = ZoneTable();
+    std::vector<long long>().swap(_pickupCounts);
+    std::vector<long long>().swap(_hourlyCounts);
+    std::vector<long long>().swap(_dropoffCounts);
+    std::vector<long long>().swap(_hourMajor);
+    _hourMajorZones = 0;
+    _hourMajorBuilt = false;
+    _routeCounts = IdPairCounts();
+    _stats.spills++;
+    return true;
+}
+
+// End of an ingestFile once anything was spilled: the rest goes out too,
+// so all counts live in one place, then each partition is merged
+void TripAnalyzer::finishSpill()
+{
+    if (spillEnabled())
+        spillAggregates();
+    _spill->consolidate();
+    _stats.spillBytes = _spill->bytes();
+    _stats.spillPartitions = _spill->partitions();
+}
+
+void TripAnalyzer::forEachZoneTotal(int partition, const std::function<void(const SpilledZone &)> &fn) const
+{
+    std::vector<uint32_t> resident;
+    for (uint32_t id = 0; id < _zones.size(); ++id)
+    {
+        if (_spill->partitionOf(_zones.name(id)) == partition)
+            resident.push_back(id);
+    }
+    // A consolidated partition already holds one record per zone
+    if (_spill->consolidated() && resident.empty())
+    {
+        _spill->forEachZone(partition, fn);
+        return;
+    }
+
+    std::unordered_map<std::string, SpilledZone> totals;
+    auto add = [&](const SpilledZone &z)
+    {
+        auto it = totals.find(z.zone);
+        if (it == totals.end())
+        {
+            totals.emplace(z.zone, z);
+            return;
+        }
+        it->second.pickups += z.pickups;
+        it->second.dropoffs += z.dropoffs;
+        for (int h = 0; h < 24; ++h)
+            it->second.hourly[h] += z.hourly[h];
+    };
+    _spill->forEachZone(partition, add);
+    SpilledZone zone;
+    for (uint32_t id : resident)
+    {
+        residentZone(id, zone);
+        add(zone);
+    }
+    for (const auto &kv : totals)
+        fn(kv.second);
+}
+
+void TripAnalyzer::forEachRouteTotal(int partition, const std::function<void(const SpilledRoute &)> &fn) const
+{
+    std::vector<SpilledRoute> resident;
+    _routeCounts.forEach([&](uint32_t pickup, uint32_t dropoff, long long count)
+                         {
+        if (_spill->partitionOf(_zones.name(pickup)) == partition)
+            resident.push_back({_zones.name(pickup), _zones.name(dropoff), count}); });
+    if (_spill->consolidated() && resident.empty())
+    {
+        _spill->forEachRoute(partition, fn);
+        return;
+    }
+
+    // Keyed by the length-prefixed pickup name followed by the dropoff
+    std::unordered_map<std::string, SpilledRoute> totals;
+    std::string key;
+    auto add = [&](const SpilledRoute &r)
+    {
+        key.assign(std::to_string(r.pickupZone.size()));
+        key += ':';
+        key += r.pickupZone;
+        key += r.dropoffZone;
+        auto it = totals.find(key);
+        if (it == totals.end())
+            totals.emplace(key, r);
+        else
+            it->second.count += r.count;
+    };
+    _spill->forEachRoute(partition, add);
+    for (const SpilledRoute &r : resident)
+        add(r);
+    for (const auto &kv : totals)
+        fn(kv.second);
+}
+
+// Spilled mode point lookup: the partition index once everything is
+// merged on disk, else a read of the zone's partition
+bool TripAnalyzer::spilledZone(std::string_view zone, SpilledZone &out) const
+{
+    if (_spill->consolidated() && _zones.size() == 0)
+        return _spill->findZone(zone, out);
+    bool found = false;
+    forEachZoneTotal(_spill->partitionOf(zone), [&](const SpilledZone &z)
+                     {
+        if (!found && z.zone == zone)
+        {
+            out = z;
+            found = true;
+        } });
+    return found;
+}
+
+void TripAnalyzer::ingestFile(const std::string &csvPath)
+{
+#ifdef TRIP_INSTRUMENT
+    auto wall0 = std::chrono::steady_clock::now();
+    uint64_t ticks0 = probeTicks();
+#endif
+    // Parallel ingest needs the whole file in memory: map it
+    ReaderOptions readerOptions = _readerOptions;
+    if (parallelIngest())
+        readerOptions.backend = ReaderBackend::Mmap;
+    std::unique_ptr<ChunkReader> reader = ChunkReader::open(csvPath, readerOptions);
+    if (!reader)
+        return;
+
+    _schema = CsvSchema();
+    _stats = IngestStats();
+#ifdef TRIP_INSTRUMENT
+    _timings.tokenizeNanos = _timings.timestampNanos = _timings.aggregateNanos = 0;
+#endif
+    _rejectRng = 0x9E3779B97F4A7C15ULL;
+
+    std::string_view chunk = reader->next();
+
+    // Profile selection looks at the first non-empty line in the first chunk
+    Delimiter delimiter = _profile.delimiter;
+    if (delimiter == Delimiter::Auto)
+    {
+        size_t start = chunk.find_first_not_of("\r\n");
+        std::string_view first = start == std::string_view::npos ? std::string_view() : chunk.substr(start);
+        delimiter = sniffDelimiter(first.substr(0, first.find('\n')));
+    }
+    bool iso = _profile.timestamp == TimestampLayout::IsoT;
+    // Falls back to the sequential path if the file could not be mapped
+    bool parallel = parallelIngest() && reader->timing().backend == ReaderBackend::Mmap;
+
+    // Runtime profile -> compile-time specialised parser
+    switch (delimiter)
+    {
+    case Delimiter::Semicolon:
+        iso ? ingestText<';', 'T'>(*reader, chunk, parallel) : ingestText<';', ' '>(*reader, chunk, parallel);
+        break;
+    case Delimiter::Tab:
+        iso ? ingestText<'\t', 'T'>(*reader, chunk, parallel) : ingestText<'\t', ' '>(*reader, chunk, parallel);
+        break;
+    default:
+        iso ? ingestText<',', 'T'>(*reader, chunk, parallel) : ingestText<',', ' '>(*reader, chunk, parallel);
+        break;
+    }
+
+    _stats.read = reader->timing();
+    if (_spill)
+        finishSpill();
+    // The hour-major copy is stale now; the next topZonesAtHour rebuilds it
+    std::vector<long long>().swap(_hourMajor);
+    _hourMajorZones = 0;
+    _hourMajorBuilt = false;
+    if (_dailyIndex)
+        buildDailyIndex();
+    if (_snapshotIntervalMs)
+        publishSnapshot(true);
+
+#ifdef TRIP_INSTRUMENT
+    // Probe buckets are in ticks; convert using this call's own wall time
+    _timings.ingestNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - wall0).count();
+    uint64_t ticks = probeTicks() - ticks0;
+    double nsPerTick = ticks ? static_cast<double>(_timings.ingestNanos) / static_cast<double>(ticks) : 0.0;
+    _timings.tokenizeNanos = static_cast<long long>(_timings.tokenizeNanos * nsPerTick);
+    _timings.timestampNanos = static_cast<long long>(_timings.timestampNanos * nsPerTick);
+    _timings.aggregateNanos = static_cast<long long>(_timings.aggregateNanos * nsPerTick);
+#endif
+    std::sort(_stats.rejectSample.begin(), _stats.rejectSample.end(),
+              [](const RejectedLine &a, const RejectedLine &b)
+              { return a.lineNumber < b.lineNumber; });
+}
+
+void TripAnalyzer::setApproximateMode(size_t capacity)
+{
+    _approxCapacity = capacity;
+    _approxZones.reset(capacity);
+    _approxSlots.reset(capacity);
+}
+
+void TripAnalyzer::setSlotSketch(size_t width, size_t depth)
+{
+    _slotSketch.reset(width, depth);
+}
+
+long long TripAnalyzer::estimateSlot(std::string_view zone, int hour) const
+{
+    if (hour < 0 || hour > 23)
+        return 0;
+    if (_slotSketch.enabled())
+        return _slotSketch.estimate(slotHash(zone, hour));
+    SpilledZone spilled;
+    if (_spill)
+        return spilledZone(zone, spilled) ? spilled.hourly[hour] : 0;
+
+    uint32_t id = _zones.find(zone);
+    return id == ZoneTable::NotFound ? 0 : _hourlyCounts[static_cast<size_t>(id) * 24 + hour];
+}
+
+void TripAnalyzer::setTripIdDedup(size_t expectedRows)
+{
+    _dedup.reset(expectedRows);
+}
+
+void TripAnalyzer::setDistinctCounting(int precision)
+{
+    _tripIdHll.reset(precision);
+    _distinctPrecision = _tripIdHll.precision();
+    _distinctRows = 0;
+    _dropoffHll.clear();
+}
+
+long long TripAnalyzer::distinctTripIds() const
+{
+    return std::llround(_tripIdHll.estimate());
+}
+
+long long TripAnalyzer::distinctDropoffs(std::string_view pickupZone) const
+{
+    auto it = _dropoffHll.find(std::string(pickupZone));
+    return it == _dropoffHll.end() ? 0 : std::llround(it->second.estimate());
+}
+
+long long TripAnalyzer::duplicateTripIdEstimate() const
+{
+    return std::max(0LL, _distinctRows - distinctTripIds());
+}
+
+bool TripAnalyzer::mergeDistinctCounters(const TripAnalyzer &shard)
+{
+    if (shard._distinctPrecision != _distinctPrecision)
+        return false;
+    _tripIdHll.merge(shard._tripIdHll);
+    _distinctRows += shard._distinctRows;
+    for (const auto &kv : shard._dropoffHll)
+    {
+        auto it = _dropoffHll.find(kv.first);
+        if (it == _dropoffHll.end())
+            _dropoffHll.emplace(kv.first, kv.second);
+        else
+            it->second.merge(kv.second);
+    }
+    return true;
+}
+
+// Count DESC, Zone ASC (exact and approximate zone rows)
+template <class Row>
+static bool zoneCountBefore(const Row &a, const Row &b)
+{
+    if (a.count != b.count)
+        return a.count > b.count;
+    return a.zone < b.zone;
+}
+
+// The time slot a row counts: its hour, or a topSlots bucket
+template <class Row>
+static int slotOf(const Row &row) { return row.hour; }
+static int slotOf(const TimeSlotCount &row) { return row.bucket; }
+
+// Count DESC, Zone ASC, Slot ASC (exact, approximate and bucketed rows)
+template <class Row>
+static bool slotCountBefore(const Row &a, const Row &b)
+{
+    if (a.count != b.count)
+        return a.count > b.count;
+    if (a.zone != b.zone)
+        return a.zone < b.zone;
+    return slotOf(a) < slotOf(b);
+}
+
+// Sort, then keep the first k (k < 0 keeps all)
+template <class Row>
+static void sortZoneCounts(std::vector<Row> &results, int k)
+{
+    std::sort(results.begin(), results.end(), zoneCountBefore<Row>);
+
+    if (k >= 0 && (size_t)k < results.size())
+    {
+        results.resize(k);
+    }
+}
+
+template <class Row>
+static void sortSlotCounts(std::vector<Row> &results, int k)
+{
+    std::sort(results.begin(), results.end(), slotCountBefore<Row>);
+
+    if (k >= 0 && (size_t)k < results.size())
+    {
+        results.resize(k);
+    }
+}
+
+std::vector<ApproxZoneCount> TripAnalyzer::topZonesApprox(int k) const
+{
+    std::vector<ApproxZoneCount> results;
+    if (!_approxCapacity)
+    {
+        for (const ZoneCount &z : topZones(k))
+            results.push_back({z.zone, z.count, 0});
+        return results;
+    }
+
+    results.reserve(_approxZones.entries().size());
+    for (const SpaceSaving::Entry &e : _approxZones.entries())
+        results.push_back({e.key, e.count, e.error});
+
+    // Same order as topZones
+    sortZoneCounts(results, k);
+    return results;
+}
+
+std::vector<ApproxSlotCount> TripAnalyzer::topBusySlotsApprox(int k) const
+{
+    std::vector<ApproxSlotCount> results;
+    if (!_approxCapacity)
+    {
+        for (const SlotCount &s : topBusySlots(k))
+            results.push_back({s.zone, s.hour, s.count, 0});
+        return results;
+    }
+
+    results.reserve(_approxSlots.entries().size());
+    for (const SpaceSaving::Entry &e : _approxSlots.entries())
+    {
+        // Key is the zone followed by one byte holding the hour
+        results.push_back({e.key.substr(0, e.key.size() - 1),
+                           static_cast<int>(static_cast<unsigned char>(e.key.back())), e.count, e.error});
+    }
+
+    // Same order as topBusySlots
+    sortSlotCounts(results, k);
+    return results;
+}
+
+// Zone tables at least this large are ranked on the pool (setThreads)
+static const size_t ParallelRankZones = 32768;
+
+// Parallel ranking: each block of ids collects its rows and keeps its own
+// top k on the pool, then sorted blocks are merged pairwise, a round at a
+// time, also on the pool. The overall top k is always among the blocks'
+// top k, so the result equals the sequential sort.
+template <class Row, class Collect, class Before>
+static std::vector<Row> rankBlocks(WorkStealingPool &pool, size_t ids, int k, Collect collect, Before before)
+{
+    const size_t Block = 16384;
+    auto trim = [k](std::vector<Row> &rows)
+    {
+        if (k >= 0 && (size_t)k < rows.size())
+            rows.resize(k);
+    };
+
+    std::vector<std::vector<Row>> parts((ids + Block - 1) / Block);
+    pool.run(parts.size(), [&](int, size_t b)
+             {
+        std::vector<Row> &part = parts[b];
+        collect(b * Block, std::min(ids, (b + 1) * Block), part);
+        size_t keep = k >= 0 && (size_t)k < part.size() ? (size_t)k : part.size();
+        std::partial_sort(part.begin(), part.begin() + keep, part.end(), before);
+        trim(part); });
+
+    while (parts.size() > 1)
+    {
+        std::vector<std::vector<Row>> merged((parts.size() + 1) / 2);
+        pool.run(parts.size() / 2, [&](int, size_t i)
+                 {
+            std::vector<Row> &a = parts[2 * i];
+            std::vector<Row> &b = parts[2 * i + 1];
+            merged[i].resize(a.size() + b.size());
+            std::merge(std::make_move_iterator(a.begin()), std::make_move_iterator(a.end()),
+                       std::make_move_iterator(b.begin()), std::make_move_iterator(b.end()),
+                       merged[i].begin(), before);
+            trim(merged[i]); });
+        if (parts.size() % 2)
+            merged.back() = std::move(parts.back());
+        parts.swap(merged);
+    }
+    return parts.empty() ? std::vector<Row>() : std::move(parts[0]);
+}
+
+// Count DESC, Pickup ASC, Dropoff ASC
+static bool routeCountBefore(const RouteCount &a, const RouteCount &b)
+{
+    if (a.count != b.count)
+        return a.count > b.count;
+    if (a.pickupZone != b.pickupZone)
+        return a.pickupZone < b.pickupZone;
+    return a.dropoffZone < b.dropoffZone;
+}
+
+static void sortRouteCounts(std::vector<RouteCount> &results, int k)
+{
+    std::sort(results.begin(), results.end(), routeCountBefore);
+
+    if (k >= 0 && (size_t)k < results.size())
+    {
+        results.resize(k);
+    }
+}
+
+// Spilled-mode ranking: every partition's rows are collected, ranked and
+// cut to k on their own, then the survivors are ranked again. A zone
+// never spans partitions, so the overall top k is among the partitions'
+// top k.
+template <class Row, class Collect, class Rank>
+static std::vector<Row> rankPartitions(int partitions, int k, Collect collect, Rank rank)
+{
+    std::vector<Row> results;
+    std::vector<Row> part;
+    for (int p = 0; p < partitions; ++p)
+    {
+        part.clear();
+        collect(p, part);
+        rank(part, k);
+        results.insert(results.end(), std::make_move_iterator(part.begin()), std::make_move_iterator(part.end()));
+    }
+    rank(results, k);
+    return results;
+}
+
+std::vector<ZoneCount> TripAnalyzer::topZones(int k) const
+{
+    TRIP_SCOPE_TIMER(rankTimer, _timings.rankNanos);
+#ifdef TRIP_INSTRUMENT
+    _timings.rankCalls++;
+#endif
+    if (_approxCapacity)
+    {
+        std::vector<ZoneCount> approx;
+        for (const ApproxZoneCount &z : topZonesApprox(k))
+            approx.push_back({z.zone, z.count});
+        return approx;
+    }
+    if (_spill)
+    {
+        auto collectSpilled = [this](int p, std::vector<ZoneCount> &rows)
+        {
+            forEachZoneTotal(p, [&](const SpilledZone &z)
+                             {
+                if (z.pickups > 0)
+                    rows.push_back({z.zone, z.pickups}); });
+        };
+        return rankPartitions<ZoneCount>(_spill->partitions(), k, collectSpilled, sortZoneCounts<ZoneCount>);
+    }
+
+    auto collect = [this](size_t begin, size_t end, std::vector<ZoneCount> &results)
+    {
+        for (size_t id = begin; id < end; ++id)
+        {
+            if (_pickupCounts[id] == 0)
+                continue; // seen only as a dropoff
+            ZoneCount z;
+            z.zone = _zones.name(static_cast<uint32_t>(id));
+            z.count = _pickupCounts[id];
+            results.push_back(z);
+        }
+    };
+    if (_pool && _zones.size() >= ParallelRankZones)
+        return rankBlocks<ZoneCount>(*_pool, _zones.size(), k, collect, zoneCountBefore<ZoneCount>);
+
+    std::vector<ZoneCount> results;
+    results.reserve(_zones.size());
+    collect(0, _zones.size(), results);
+    sortZoneCounts(results, k);
+    return results;
+}
+
+std::vector<SlotCount> TripAnalyzer::topBusySlots(int k) const
+{
+    TRIP_SCOPE_TIMER(rankTimer, _timings.rankNanos);
+#ifdef TRIP_INSTRUMENT
+    _timings.rankCalls++;
+#endif
+    if (_approxCapacity)
+    {
+        std::vector<SlotCount> approx;
+        for (const ApproxSlotCount &s : topBusySlotsApprox(k))
+            approx.push_back({s.zone, s.hour, s.count});
+        return approx;
+    }
+    if (_spill)
+    {
+        auto collectSpilled = [this](int p, std::vector<SlotCount> &rows)
+        {
+            forEachZoneTotal(p, [&](const SpilledZone &z)
+                             {
+                for (int h = 0; h < 24; ++h)
+                {
+                    if (z.hourly[h] > 0)
+                        rows.push_back({z.zone, h, z.hourly[h]});
+                } });
+        };
+        return rankPartitions<SlotCount>(_spill->partitions(), k, collectSpilled, sortSlotCounts<SlotCount>);
+    }
+
+    auto collect = [this](size_t begin, size_t end, std::vector<SlotCount> &results)
+    {
+        for (size_t id = begin; id < end; ++id)
+        {
+            const long long *hours = &_hourlyCounts[id * 24];
+
+            for (int h = 0; h < 24; ++h)
+            {
+                if (hours[h] > 0)
+                {
+                    SlotCount s;
+                    s.zone = _zones.name(static_cast<uint32_t>(id));
+                    s.hour = h;
+                    s.count = hours[h];
+                    results.push_back(s);
+                }
+            }
+        }
+    };
+    if (_pool && _zones.size() >= ParallelRankZones)
+        return rankBlocks<SlotCount>(*_pool, _zones.size(), k, collect, slotCountBefore<SlotCount>);
+
+    std::vector<SlotCount> results;
+    results.reserve(_zones.size() * 5);
+    collect(0, _zones.size(), results);
+    sortSlotCounts(results, k);
+    return results;
+}
+
+// Index of the first maximum of 24 hourly counts
+static int argmax24Scalar(const long long *hours)
+{
+    int best = 0;
+    for (int h = 1; h < 24; ++h)
+    {
+        if (hours[h] > hours[best])
+            best = h;
+    }
+    return best;
+}
+
+#ifdef TRIP_HAVE_AVX2_ARGMAX
+// Six 4-lane vectors: a lane-wise max, a horizontal max, then one equality
+// mask over all 24 lanes whose lowest set bit is the earliest peak hour
+__attribute__((target("avx2"))) static int argmax24Avx2(const long long *hours)
+{
+    const __m256i *v = reinterpret_cast<const __m256i *>(hours);
+    __m256i lanes[6];
+    for (int i = 0; i < 6; ++i)
+        lanes[i] = _mm256_loadu_si256(v + i);
+    __m256i m = lanes[0];
+    for (int i = 1; i < 6; ++i)
+        m = _mm256_blendv_epi8(m, lanes[i], _mm256_cmpgt_epi64(lanes[i], m));
+
+    alignas(32) long long folded[4];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(folded), m);
+    long long best = std::max(std::max(folded[0], folded[1]), std::max(folded[2], folded[3]));
+
+    __m256i target = _mm256_set1_epi64x(best);
+    uint32_t mask = 0;
+    for (int i = 0; i < 6; ++i)
+    {
+        int bits = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(lanes[i], target)));
+        mask |= static_cast<uint32_t>(bits) << (4 * i);
+    }
+    return __builtin_ctz(mask);
+}
+#endif
+
+std::vector<SlotCount> TripAnalyzer::peakHours() const
+{
+    TRIP_SCOPE_TIMER(rankTimer, _timings.rankNanos);
+    std::vector<SlotCount> results;
+
+    if (_approxCapacity)
+    {
+        // The first slot of each zone in topBusySlots order is its peak
+        std::unordered_set<std::string> seen;
+        for (const ApproxSlotCount &s : topBusySlotsApprox(-1))
+        {
+            if (seen.insert(s.zone).second)
+                results.push_back({s.zone, s.hour, s.count});
+        }
+    }
+    else if (_spill)
+    {
+        for (int p = 0; p < _spill->partitions(); ++p)
+        {
+            forEachZoneTotal(p, [&](const SpilledZone &z)
+                             {
+                if (z.pickups == 0)
+                    return; // seen only as a dropoff
+                int h = argmax24Scalar(z.hourly);
+                results.push_back({z.zone, h, z.hourly[h]}); });
+        }
+    }
+    else
+    {
+        size_t zones = _zones.size();
+        std::vector<uint8_t> peak(zones);
+        int (*argmax)(const long long *) = argmax24Scalar;
+#ifdef TRIP_HAVE_AVX2_ARGMAX
+        if (__builtin_cpu_supports("avx2"))
+            argmax = argmax24Avx2;
+#endif
+        auto scan = [&](size_t begin, size_t end)
+        {
+            for (size_t id = begin; id < end; ++id)
+                peak[id] = static_cast<uint8_t>(argmax(&_hourlyCounts[id * 24]));
+        };
+
+        // Blocks of ids on the pool, like rankBlocks; each writes its own
+        // slice of `peak`
+        if (_pool && zones >= ParallelRankZones)
+        {
+            const size_t Block = 16384;
+            _pool->run((zones + Block - 1) / Block, [&](int, size_t b)
+                       { scan(b * Block, std::min(zones, (b + 1) * Block)); });
+        }
+        else
+        {
+            scan(0, zones);
+        }
+
+        results.reserve(zones);
+        for (uint32_t id = 0; id < zones; ++id)
+        {
+            if (_pickupCounts[id] == 0)
+                continue; // seen only as a dropoff
+            int h = peak[id];
+            results.push_back({_zones.name(id), h, _hourlyCounts[static_cast<size_t>(id) * 24 + h]});
+        }
+    }
+
+    std::sort(results.begin(), results.end(), [](const SlotCount &a, const SlotCount &b)
+              { return a.zone < b.zone; });
+    return results;
+}
+
+// FareStats for cell i of a pair of fixed-point columns; i == npos or a
+// column that was never sized gives all zeros
+static FareStats fareStatsAt(const FixedPointColumn &fare, const FixedPointColumn &distance, size_t i)
+{
+    FareStats out;
+    if (i >= fare.count.size())
+        return out;
+    out.fareRows = fare.count[i];
+    if (out.fareRows)
+    {
+        out.fareSum = fare.sum[i] / 100.0;
+        out.fareMean = out.fareSum / static_cast<double>(out.fareRows);
+        out.fareMax = fare.max[i] / 100.0;
+    }
+    out.distanceRows = distance.count[i];
+    if (out.distanceRows)
+    {
+        out.distanceSum = distance.sum[i] / 100.0;
+        out.distanceMean = out.distanceSum / static_cast<double>(out.distanceRows);
+        out.distanceMax = distance.max[i] / 100.0;
+    }
+    return out;
+}
+
+FareStats TripAnalyzer::zoneFareStats(std::string_view zone) const
+{
+    uint32_t id = _zones.find(zone);
+    return fareStatsAt(_zoneFare, _zoneDistance, id == ZoneTable::NotFound ? std::string_view::npos : id);
+}
+
+FareStats TripAnalyzer::slotFareStats(std::string_view zone, int hour) const
+{
+    uint32_t id = _zones.find(zone);
+    if (id == ZoneTable::NotFound || hour < 0 || hour > 23)
+        return FareStats();
+    return fareStatsAt(_slotFare, _slotDistance, static_cast<size_t>(id) * 24 + hour);
+}
+
+std::vector<ZoneRevenue> TripAnalyzer::topZonesByRevenue(int k) const
+{
+    TRIP_SCOPE_TIMER(rankTimer, _timings.rankNanos);
+    // Rank on the exact fixed-point sums, convert at the end
+    struct Row
+    {
+        uint32_t id;
+        long long cents;
+    };
+    std::vector<Row> rows;
+    for (uint32_t id = 0; id < _zoneFare.count.size() && id < _zones.size(); ++id)
+    {
+        if (_zoneFare.count[id] > 0)
+            rows.push_back({id, _zoneFare.sum[id]});
+    }
+
+    // Sort: Revenue DESC, Zone ASC
+    std::sort(rows.begin(), rows.end(), [&](const Row &a, const Row &b)
+              {
+        if (a.cents != b.cents) {
+            return a.cents > b.cents;
+        }
+        return _zones.name(a.id) < _zones.name(b.id); });
+
+    if (k >= 0 && (size_t)k < rows.size())
+    {
+        rows.resize(k);
+    }
+    std::vector<ZoneRevenue> results;
+    results.reserve(rows.size());
+    for (const Row &r : rows)
+        results.push_back({_zones.name(r.id), r.cents / 100.0, _pickupCounts[r.id]});
+    return results;
+}
+
+void TripAnalyzer::setFareStats(bool enabled)
+{
+    _fareStats = enabled;
+    if (enabled)
+    {
+        // Zones interned before this call need their cells too
+        size_t n = _pickupCounts.size();
+        _zoneFare.resize(n);
+        _zoneDistance.resize(n);
+        _slotFare.resize(n * 24);
+        _slotDistance.resize(n * 24);
+    }
+}
+
+std::string timeBucketLabel(TimeGranularity granularity, int bucket)
+{
+    static const char *const weekdays[] = {"Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Sun"};
+    char buf[16];
+    switch (granularity)
+    {
+    case TimeGranularity::Hour:
+        std::snprintf(buf, sizeof(buf), "%02d", bucket);
+        return buf;
+    case TimeGranularity::QuarterHour:
+        std::snprintf(buf, sizeof(buf), "%02d:%02d", bucket / 4, bucket % 4 * 15);
+        return buf;
+    case TimeGranularity::DayOfWeek:
+        return bucket >= 0 && bucket < 7 ? weekdays[bucket] : "?";
+    case TimeGranularity::DayType:
+        return bucket == 1 ? "weekend" : "weekday";
+    case TimeGranularity::Date:
+        return formatDayIndex(bucket);
+    }
+    return "?";
+}
+
+void TripAnalyzer::setTimeBuckets(bool enabled)
+{
+    _timeBuckets = enabled;
+    if (enabled)
+    {
+        size_t n = _pickupCounts.size();
+        _quarterCounts.resize(n * 96, 0);
+        _weekdayCounts.resize(n * 7, 0);
+    }
+}
+
+std::vector<TimeSlotCount> TripAnalyzer::topSlots(int k, TimeGranularity granularity) const
+{
+    TRIP_SCOPE_TIMER(rankTimer, _timings.rankNanos);
+    std::vector<TimeSlotCount> results;
+    // Dense per-zone rows: `width` buckets per zone id
+    auto collect = [&](const std::vector<long long> &cells, int width)
+    {
+        size_t zones = std::min(_zones.size(), cells.size() / width);
+        for (uint32_t id = 0; id < zones; ++id)
+        {
+            const long long *row = &cells[static_cast<size_t>(id) * width];
+            for (int b = 0; b < width; ++b)
+            {
+                if (row[b] > 0)
+                    results.push_back({_zones.name(id), b, row[b]});
+            }
+        }
+    };
+
+    switch (granularity)
+    {
+    case TimeGranularity::Hour:
+        if (_spill)
+        {
+            for (SlotCount &slot : topBusySlots(k))
+                results.push_back({std::move(slot.zone), slot.hour, slot.count});
+            return results;
+        }
+        collect(_hourlyCounts, 24);
+        break;
+    case TimeGranularity::QuarterHour:
+        collect(_quarterCounts, 96);
+        break;
+    case TimeGranularity::DayOfWeek:
+        collect(_weekdayCounts, 7);
+        break;
+    case TimeGranularity::DayType:
+    {
+        std::vector<long long> split(_weekdayCounts.size() / 7 * 2, 0);
+        for (size_t i = 0; i < _weekdayCounts.size(); ++i)
+            split[i / 7 * 2 + (i % 7 >= 5)] += _weekdayCounts[i];
+        collect(split, 2);
+        break;
+    }
+    case TimeGranularity::Date:
+        _dayCounts.forEach([&](uint32_t id, uint32_t day, long long count)
+                           { results.push_back({_zones.name(id), static_cast<int>(day), count}); });
+        break;
+    }
+
+    sortSlotCounts(results, k);
+    return results;
+}
+
+std::vector<ZoneCount> AggregateSnapshot::topZones(int k) const
+{
+    std::vector<ZoneCount> results;
+    for (size_t id = 0; id < pickupCounts.size(); ++id)
+    {
+        if (pickupCounts[id] > 0)
+            results.push_back({(*names)[id], pickupCounts[id]});
+    }
+    sortZoneCounts(results, k);
+    return results;
+}
+
+std::vector<SlotCount> AggregateSnapshot::topBusySlots(int k) const
+{
+    std::vector<SlotCount> results;
+    for (size_t id = 0; id < pickupCounts.size(); ++id)
+    {
+        const long long *hours = &hourlyCounts[id * 24];
+        for (int h = 0; h < 24; ++h)
+        {
+            if (hours[h] > 0)
+                results.push_back({(*names)[id], h, hours[h]});
+        }
+    }
+    sortSlotCounts(results, k);
+    return results;
+}
+
+void TripAnalyzer::setSnapshotInterval(int milliseconds)
+{
+    _snapshotIntervalMs = std::max(milliseconds, 0);
+    _snapshotGapNanos = static_cast<long long>(_snapshotIntervalMs) * 1000000;
+}
+
+// Copies the exact counts into a new snapshot and swaps it in. Runs on the
+// ingest thread, between rows; readers never see a half-built value. A
+// mid-file publish is skipped while a reader still pins the snapshot
+// before last, so ingest never waits on a slow query.
+void TripAnalyzer::publishSnapshot(bool final)
+{
+    if (_approxCapacity || _spill || (!final && !_snapshots->reclaim(false)))
+        return;
+    auto started = std::chrono::steady_clock::now();
+
+    std::unique_ptr<AggregateSnapshot> next(new AggregateSnapshot);
+    next->sequence = ++_snapshotSequence;
+    next->final = final;
+    size_t zones = _zones.size();
+    const AggregateSnapshot *previous = _snapshots->latest();
+    if (previous && previous->names->size() == zones)
+        next->names = previous->names;
+    else
+        next->names = std::make_shared<const std::vector<std::string>>(_zones.names());
+    next->pickupCounts.assign(_pickupCounts.begin(), _pickupCounts.begin() + zones);
+    next->hourlyCounts.assign(_hourlyCounts.begin(), _hourlyCounts.begin() + zones * 24);
+    for (long long c : next->pickupCounts)
+        next->trips += c;
+    _snapshots->publish(std::move(next));
+
+    // Keep publishing under ~5% of ingest time: the gap is at least 20x
+    // what this publish cost
+    long long cost = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count();
+    _snapshotGapNanos = std::max(static_cast<long long>(_snapshotIntervalMs) * 1000000, 20 * cost);
+}
+
+void TripAnalyzer::setDailyIndex(bool enabled)
+{
+    _dailyIndex = enabled;
+    if (!enabled)
+    {
+        std::vector<long long>().swap(_dayPrefix);
+        _indexDays = 0;
+        _indexZoneIds.clear();
+    }
+}
+
+// Rebuilds the prefix-sum index from the (zone, day) counts. Layout is
+// day-major: row d holds every indexed zone's trips on days
+// [first, first + d), so a range query subtracts two contiguous rows.
+// Columns are the zones with dated pickups only (dropoff-only zones have
+// none). The matrix is capped at MaxIndexBytes, and the rows span at most
+// MaxIndexDays or whatever fits in that cap for this many columns. With a
+// wider date range (e.g. a few bogus years) they cover the window holding
+// the most trips; queries reaching outside it, or every query when not
+// even one day fits, fall back to scanning the counts.
+void TripAnalyzer::buildDailyIndex()
+{
+    const size_t MaxIndexBytes = size_t(256) << 20;
+    std::vector<std::pair<int, long long>> perDay; // (day, trips), sorted
+    {
+        std::unordered_map<int, long long> totals;
+        _dayCounts.forEach([&](uint32_t, uint32_t day, long long count)
+                           { totals[static_cast<int>(day)] += count; });
+        perDay.assign(totals.begin(), totals.end());
+        std::sort(perDay.begin(), perDay.end());
+    }
+    std::vector<long long>().swap(_dayPrefix);
+    _indexDays = 0;
+    _indexZoneIds.clear();
+    if (perDay.empty())
+        return;
+
+    // Column per zone with dated pickups, in id order
+    const uint32_t NoColumn = UINT32_MAX;
+    std::vector<uint32_t> columnOf(_zones.size(), NoColumn);
+    _dayCounts.forEach([&](uint32_t zone, uint32_t, long long)
+                       { columnOf[zone] = 0; });
+    for (uint32_t id = 0; id < columnOf.size(); ++id)
+    {
+        if (columnOf[id] != NoColumn)
+        {
+            columnOf[id] = static_cast<uint32_t>(_indexZoneIds.size());
+            _indexZoneIds.push_back(id);
+        }
+    }
+    size_t columns = _indexZoneIds.size();
+    size_t fitRows = MaxIndexBytes / (columns * sizeof(long long));
+    if (fitRows < 2)
+    {
+        _indexZoneIds.clear(); // not even one day fits: always scan
+        return;
+    }
+    const int MaxIndexDays = static_cast<int>(std::min<size_t>(3660, fitRows - 1));
+
+    // Densest window of at most MaxIndexDays days (two pointers)
+    size_t bestLo = 0, lo = 0;
+    long long best = -1, inWindow = 0;
+    for (size_t hi = 0; hi < perDay.size(); ++hi)
+    {
+        inWindow += perDay[hi].second;
+        while (perDay[hi].first - perDay[lo].first >= MaxIndexDays)
+            inWindow -= perDay[lo++].second;
+        if (inWindow > best)
+        {
+            best = inWindow;
+            bestLo = lo;
+        }
+    }
+    _indexFirstDay = perDay[bestLo].first;
+    int lastDay = _indexFirstDay;
+    for (size_t i = bestLo; i < perDay.size() && perDay[i].first - _indexFirstDay < MaxIndexDays; ++i)
+        lastDay = perDay[i].first;
+    _indexDays = lastDay - _indexFirstDay + 1;
+
+    // Scatter the day counts into rows 1.., then accumulate row by row
+    _dayPrefix.assign(static_cast<size_t>(_indexDays + 1) * columns, 0);
+    _dayCounts.forEach([&](uint32_t zone, uint32_t day, long long count)
+                       {
+        long long offset = static_cast<int>(day) - static_cast<long long>(_indexFirstDay);
+        if (offset >= 0 && offset < _indexDays)
+            _dayPrefix[static_cast<size_t>(offset + 1) * columns + columnOf[zone]] += count; });
+    for (int d = 1; d <= _indexDays; ++d)
+    {
+        long long *row = &_dayPrefix[static_cast<size_t>(d) * columns];
+        const long long *prev = row - columns;
+        for (size_t c = 0; c < columns; ++c)
+            row[c] += prev[c];
+    }
+}
+
+std::vector<ZoneCount> TripAnalyzer::topZones(int k, std::string_view from, std::string_view to) const
+{
+    TRIP_SCOPE_TIMER(rankTimer, _timings.rankNanos);
+    std::vector<ZoneCount> results;
+    int first = parseDayIndex(from);
+    int last = parseDayIndex(to);
+    if (first == INT_MIN || last == INT_MIN || first > last)
+        return results;
+
+    std::vector<long long> counts(_zones.size(), 0);
+    if (_indexDays > 0 && first >= _indexFirstDay && last < _indexFirstDay + _indexDays)
+    {
+        // Fast path: two prefix rows, O(indexed zones)
+        size_t columns = _indexZoneIds.size();
+        const long long *hi = &_dayPrefix[static_cast<size_t>(last - _indexFirstDay + 1) * columns];
+        const long long *lo = &_dayPrefix[static_cast<size_t>(first - _indexFirstDay) * columns];
+        for (size_t c = 0; c < columns; ++c)
+            counts[_indexZoneIds[c]] = hi[c] - lo[c];
+    }
+    else
+    {
+        _dayCounts.forEach([&](uint32_t zone, uint32_t day, long long count)
+                           {
+            int d = static_cast<int>(day);
+            if (d >= first && d <= last)
+                counts[zone] += count; });
+    }
+
+    for (uint32_t id = 0; id < counts.size(); ++id)
+    {
+        if (counts[id] > 0)
+            results.push_back({_zones.name(id), counts[id]});
+    }
+
+    sortZoneCounts(results, k);
+    return results;
+}
+
+// Transpose _hourlyCounts so each hour's counts are contiguous. Tiles of
+// 64 zones keep both the source rows and the 24 destination runs in cache.
+void TripAnalyzer::buildHourMajor() const
+{
+    size_t zones = _approxCapacity ? 0 : _zones.size();
+    _hourMajorZones = zones;
+    _hourMajor.assign(zones * 24, 0);
+    const size_t Tile = 64;
+    for (size_t base = 0; base < zones; base += Tile)
+    {
+        size_t end = std::min(zones, base + Tile);
+        for (int h = 0; h < 24; ++h)
+        {
+            long long *column = &_hourMajor[static_cast<size_t>(h) * zones];
+            for (size_t id = base; id < end; ++id)
+                column[id] = _hourlyCounts[id * 24 + h];
+        }
+    }
+}
+
+std::vector<ZoneCount> TripAnalyzer::topZonesAtHour(int hour, int k) const
+{
+    TRIP_SCOPE_TIMER(rankTimer, _timings.rankNanos);
+    std::vector<ZoneCount> results;
+    if (hour < 0 || hour > 23)
+        return results;
+
+    if (_approxCapacity)
+    {
+        for (const ApproxSlotCount &s : topBusySlotsApprox(-1))
+        {
+            if (s.hour == hour)
+                results.push_back({s.zone, s.count});
+        }
+        if (k >= 0 && (size_t)k < results.size())
+        {
+            results.resize(k);
+        }
+        return results;
+    }
+    if (_spill)
+    {
+        auto collectSpilled = [this, hour](int p, std::vector<ZoneCount> &rows)
+        {
+            forEachZoneTotal(p, [&](const SpilledZone &z)
+                             {
+                if (z.hourly[hour] > 0)
+                    rows.push_back({z.zone, z.hourly[hour]}); });
+        };
+        return rankPartitions<ZoneCount>(_spill->partitions(), k, collectSpilled, sortZoneCounts<ZoneCount>);
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(*_hourMajorLock);
+        if (!_hourMajorBuilt)
+        {
+            buildHourMajor();
+            _hourMajorBuilt = true;
+        }
+    }
+
+    // Rank (count, id) pairs from the hour's row, then look up names only
+    // for the survivors
+    const long long *column = _hourMajor.data() + static_cast<size_t>(hour) * _hourMajorZones;
+    std::vector<std::pair<long long, uint32_t>> cells;
+    for (uint32_t id = 0; id < _hourMajorZones; ++id)
+    {
+        if (column[id] > 0)
+            cells.push_back({column[id], id});
+    }
+
+    auto byCountThenName = [this](const std::pair<long long, uint32_t> &a, const std::pair<long long, uint32_t> &b)
+    {
+        if (a.first != b.first) {
+            return a.first > b.first;
+        }
+        return _zones.name(a.second) < _zones.name(b.second);
+    };
+    size_t keep = k >= 0 && (size_t)k < cells.size() ? (size_t)k : cells.size();
+    std::partial_sort(cells.begin(), cells.begin() + keep, cells.end(), byCountThenName);
+
+    results.reserve(keep);
+    for (size_t i = 0; i < keep; ++i)
+        results.push_back({_zones.name(cells[i].second), cells[i].first});
+    return results;
+}
+
+long long TripAnalyzer::zoneCount(std::string_view zone) const
+{
+    if (_approxCapacity)
+        return _approxZones.count(zone);
+    SpilledZone spilled;
+    if (_spill)
+        return spilledZone(zone, spilled) ? spilled.pickups : 0;
+    uint32_t id = _zones.find(zone);
+    return id == ZoneTable::NotFound ? 0 : _pickupCounts[id];
+}
+
+HourlyView TripAnalyzer::zoneHourly(std::string_view zone) const
+{
+    HourlyView view;
+    uint32_t id = _zones.find(zone);
+    if (id != ZoneTable::NotFound && !_approxCapacity && !_spill)
+        view.data = &_hourlyCounts[static_cast<size_t>(id) * 24];
+    return view;
+}
+
+void TripAnalyzer::zoneCounts(const std::string_view *zones, size_t count, long long *out) const
+{
+    if (_approxCapacity)
+    {
+        for (size_t i = 0; i < count; ++i)
+            out[i] = _approxZones.count(zones[i]);
+        return;
+    }
+    if (_spill)
+    {
+        // One read of each partition that holds any of the zones
+        std::vector<std::unordered_map<std::string_view, std::vector<size_t>>> wanted(_spill->partitions());
+        for (size_t i = 0; i < count; ++i)
+        {
+            out[i] = 0;
+            wanted[_spill->partitionOf(zones[i])][zones[i]].push_back(i);
+        }
+        for (int p = 0; p < _spill->partitions(); ++p)
+        {
+            if (wanted[p].empty())
+                continue;
+            forEachZoneTotal(p, [&](const SpilledZone &z)
+                             {
+                auto it = wanted[p].find(z.zone);
+                if (it == wanted[p].end())
+                    return;
+                for (size_t i : it->second)
+                    out[i] = z.pickups; });
+        }
+        return;
+    }
+    const size_t Chunk = 256;
+    uint32_t ids[Chunk];
+    for (size_t base = 0; base < count; base += Chunk)
+    {
+        size_t n = std::min(Chunk, count - base);
+        _zones.findBatch(zones + base, n, ids);
+        for (size_t i = 0; i < n; ++i)
+            out[base + i] = ids[i] == ZoneTable::NotFound ? 0 : _pickupCounts[ids[i]];
+    }
+}
+
+std::vector<long long> TripAnalyzer::zoneCounts(const std::vector<std::string_view> &zones) const
+{
+    std::vector<long long> out(zones.size());
+    zoneCounts(zones.data(), zones.size(), out.data());
+    return out;
+}
+
+std::vector<RouteCount> TripAnalyzer::topRoutes(int k) const
+{
+    TRIP_SCOPE_TIMER(rankTimer, _timings.rankNanos);
+    if (_spill)
+    {
+        auto collectSpilled = [this](int p, std::vector<RouteCount> &rows)
+        {
+            forEachRouteTotal(p, [&](const SpilledRoute &r)
+                              { rows.push_back({r.pickupZone, r.dropoffZone, r.count}); });
+        };
+        return rankPartitions<RouteCount>(_spill->partitions(), k, collectSpilled, sortRouteCounts);
+    }
+
+    std::vector<RouteCount> results;
+    results.reserve(_routeCounts.size());
+    _routeCounts.forEach([&](uint32_t pickup, uint32_t dropoff, long long count)
+                         { results.push_back({_zones.name(pickup), _zones.name(dropoff), count}); });
+    sortRouteCounts(results, k);
+    return results;
+}
+
+std::vector<ZoneCount> TripAnalyzer::topDropoffZones(int k) const
+{
+    TRIP_SCOPE_TIMER(rankTimer, _timings.rankNanos);
+    if (_spill)
+    {
+        auto collectSpilled = [this](int p, std::vector<ZoneCount> &rows)
+        {
+            forEachZoneTotal(p, [&](const SpilledZone &z)
+                             {
+                if (z.dropoffs > 0)
+                    rows.push_back({z.zone, z.dropoffs}); });
+        };
+        return rankPartitions<ZoneCount>(_spill->partitions(), k, collectSpilled, sortZoneCounts<ZoneCount>);
+    }
+
+    std::vector<ZoneCount> results;
+    for (uint32_t id = 0; id < _zones.size(); ++id)
+    {
+        if (_dropoffCounts[id] > 0)
+            results.push_back({_zones.name(id), _dropoffCounts[id]});
+    }
+    sortZoneCounts(results, k);
+    return results;
+}
+
+AnalyzerMetrics TripAnalyzer::metrics() const
+{
+    AnalyzerMetrics m = _timings;
+#ifdef TRIP_INSTRUMENT
+    m.timingEnabled = true;
+#endif
+    m.readNanos = _stats.read.readNanos;
+    m.readStallNanos = _stats.read.stallNanos;
+    m.bytes = _stats.read.bytesRead;
+    m.rows = _stats.linesRead;
+    m.rowsAccepted = _stats.rowsAccepted;
+    m.distinctZones = static_cast<long long>(_zones.size());
+    m.hashBuckets = static_cast<long long>(_zones.bucketCount());
+    m.loadFactor = _zones.loadFactor();
+    return m;
+}
+
+void TripAnalyzer::writeMetricsJson(std::ostream &out) const
+{
+    AnalyzerMetrics m = metrics();
+    out << "{\"timing_enabled\":" << (m.timingEnabled ? "true" : "false")
+        << ",\"read_ns\":" << m.readNanos
+        << ",\"read_stall_ns\":" << m.readStallNanos
+        << ",\"tokenize_ns\":" << m.tokenizeNanos
+        << ",\"timestamp_ns\":" << m.timestampNanos
+        << ",\"aggregate_ns\":" << m.aggregateNanos
+        << ",\"ingest_ns\":" << m.ingestNanos
+        << ",\"rank_ns\":" << m.rankNanos
+        << ",\"rank_calls\":" << m.rankCalls
+        << ",\"bytes\":" << m.bytes
+        << ",\"rows\":" << m.rows
+        << ",\"rows_accepted\":" << m.rowsAccepted
+        << ",\"distinct_zones\":" << m.distinctZones
+        << ",\"hash_buckets\":" << m.hashBuckets
+        << ",\"load_factor\":" << m.loadFactor
+        << "}\n";
 }
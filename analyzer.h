@@ -1,5 +1,16 @@
 #pragma once
+#include "chunk_reader.h"
+#include "sketches.h"
+#include "snapshot.h"
+#include "spill.h"
+#include "thread_pool.h"
+#include "zone_table.h"
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <unordered_map>
 
@@ -16,9 +27,255 @@ struct SlotCount
     long long count;
 };
 
+struct RouteCount
+{
+    std::string pickupZone;
+    std::string dropoffZone;
+    long long count;
+};
+
+// Fare and distance aggregates for one zone or (zone, hour) slot. Fares
+// are in currency units, distances in the file's unit; both are summed in
+// hundredths. Means and maxima cover the rows where the column parsed
+// (fareRows / distanceRows); with none they are 0.
+struct FareStats
+{
+    long long fareRows = 0;
+    double fareSum = 0.0;
+    double fareMean = 0.0;
+    double fareMax = 0.0;
+    long long distanceRows = 0;
+    double distanceSum = 0.0;
+    double distanceMean = 0.0;
+    double distanceMax = 0.0;
+};
+
+struct ZoneRevenue
+{
+    std::string zone;
+    double revenue; // sum of fares
+    long long trips;
+};
+
+// Bucketing of the pickup time for topSlots
+enum class TimeGranularity
+{
+    Hour,        // hour of day, 0-23 (the topBusySlots buckets)
+    QuarterHour, // 15-minute slot of the day, 0-95
+    DayOfWeek,   // 0 = Monday ... 6 = Sunday
+    DayType,     // 0 = weekday, 1 = weekend
+    Date         // days since 1970-01-01
+};
+
+struct TimeSlotCount
+{
+    std::string zone;
+    int bucket; // meaning depends on the granularity, see timeBucketLabel
+    long long count;
+};
+
+// Human-readable bucket: "07", "07:45", "Mon", "weekend", "2024-03-01"
+std::string timeBucketLabel(TimeGranularity granularity, int bucket);
+
+// Read-only view of one zone's 24 hourly counts (zoneHourly). Empty for
+// an unknown zone; valid until the next ingestFile.
+struct HourlyView
+{
+    const long long *data = nullptr;
+
+    bool empty() const { return data == nullptr; }
+    size_t size() const { return data ? 24 : 0; }
+    long long operator[](int hour) const { return data ? data[hour] : 0; }
+    const long long *begin() const { return data; }
+    const long long *end() const { return data ? data + 24 : nullptr; }
+};
+
+// Approximate-mode results: the true count lies in [count - error, count]
+struct ApproxZoneCount
+{
+    std::string zone;
+    long long count;
+    long long error;
+};
+
+struct ApproxSlotCount
+{
+    std::string zone;
+    int hour; // 0–23
+    long long count;
+    long long error;
+};
+
+// Column positions used by ingestFile, resolved once per file from the
+// header row, or positional (per row) when the file has no usable header.
+// -1 marks a column the file does not have.
+struct CsvSchema
+{
+    int tripId = 0;
+    int pickupZone = 1;
+    int dropoffZone = -1;
+    int pickupTime = 2;
+    int distance = -1;
+    int fare = -1;
+
+    // Highest column index every row must have (pickup zone and time)
+    int lastRequired = 2;
+    // Highest column index the row parser reads; splitting stops there.
+    // Beyond lastRequired when an optional feature wants another column.
+    int lastNeeded = 2;
+    // No usable header: the layout is picked per row by its column count
+    bool positional = false;
+};
+
+// Why ingestFile skipped a row. Every non-blank, non-header line is either
+// accepted, dropped as a duplicate trip ID, or counted under exactly one
+// of these.
+enum class RejectReason
+{
+    TooFewColumns,
+    EmptyZone,
+    EmptyTime,
+    NoSpace,        // no date/time separator in PickupTime
+    NoColon,        // no ':' after the separator
+    NonNumericHour,
+    HourOutOfRange,
+    Count
+};
+
+const char *rejectReasonName(RejectReason reason);
+
+struct RejectedLine
+{
+    long long lineNumber; // 1-based line number in the file
+    RejectReason reason;
+    std::string text;
+};
+
+// Row accounting for the most recent ingestFile call
+struct IngestStats
+{
+    long long linesRead = 0; // including header and blank lines
+    long long headerRows = 0;
+    long long blankLines = 0;
+    long long rowsAccepted = 0;
+    long long rejects[static_cast<int>(RejectReason::Count)] = {};
+
+    // Trip ID dedup (TripAnalyzer::setTripIdDedup): valid rows dropped as
+    // repeats of an earlier trip ID, and filter hits that turned out to be
+    // new IDs on exact verification
+    long long duplicateRows = 0;
+    long long dedupFalsePositives = 0;
+
+    // Uniform sample of rejected lines (reservoir), at most
+    // TripAnalyzer::setRejectSampleSize() entries, ordered by line number.
+    std::vector<RejectedLine> rejectSample;
+
+    // I/O side: backend used, bytes read, and how much read time was
+    // hidden behind parsing
+    ReadTiming read;
+
+    // Parallel ingest counted zones in one shared table
+    // (TripAnalyzer::setZoneTableMode)
+    bool sharedZoneTable = false;
+
+    // Memory budget (TripAnalyzer::setMemoryBudget): times the aggregates
+    // were spilled to disk during this call, and the spill files' size
+    // and partition count after it (0 if nothing was ever spilled)
+    long long spills = 0;
+    long long spillBytes = 0;
+    int spillPartitions = 0; // hash partitions of the spill files
+
+    long long rejected(RejectReason reason) const { return rejects[static_cast<int>(reason)]; }
+    long long rejectedTotal() const;
+};
+
+enum class Delimiter
+{
+    Comma,
+    Semicolon,
+    Tab,
+    Auto // most frequent of the three in the file's first line
+};
+
+enum class TimestampLayout
+{
+    SpaceSeparated, // 2024-01-01 10:30
+    IsoT            // 2024-01-01T10:30
+};
+
+// Input dialect. Selected at runtime; each combination is served by its own
+// template-specialised row parser.
+struct ParserProfile
+{
+    Delimiter delimiter = Delimiter::Comma;
+    TimestampLayout timestamp = TimestampLayout::SpaceSeparated;
+};
+
+// Where the time went. Timing fields are only filled in builds with
+// -DTRIP_INSTRUMENT (make INSTRUMENT=1); otherwise they stay zero and the
+// probes compile to nothing. Counts and table shape are always available.
+struct AnalyzerMetrics
+{
+    bool timingEnabled = false;
+
+    // Most recent ingestFile, nanoseconds. With parallel ingest the stage
+    // times are summed over the workers.
+    long long readNanos = 0;      // inside read calls (may overlap parsing)
+    long long readStallNanos = 0; // parser blocked waiting for data
+    long long tokenizeNanos = 0;  // line splitting + field projection
+    long long timestampNanos = 0; // zone/time extraction + hour parsing
+    long long aggregateNanos = 0; // hash table updates
+    long long ingestNanos = 0;    // whole ingestFile call
+
+    // All topZones/topBusySlots calls so far
+    long long rankNanos = 0;
+    long long rankCalls = 0;
+
+    long long bytes = 0;
+    long long rows = 0; // lines read
+    long long rowsAccepted = 0;
+    long long distinctZones = 0; // interned zone names, pickup or dropoff
+    long long hashBuckets = 0;
+    double loadFactor = 0.0;
+};
+
+// Immutable copy of the exact zone and hourly counts, published during
+// ingestFile (TripAnalyzer::setSnapshotInterval) for readers on other
+// threads. Rankings follow TripAnalyzer's.
+class AggregateSnapshot
+{
+public:
+    std::vector<ZoneCount> topZones(int k = 10) const;
+    std::vector<SlotCount> topBusySlots(int k = 10) const;
+
+    long long sequence = 0; // 1, 2, ... per analyzer
+    long long trips = 0;    // sum of pickupCounts
+    bool final = false;     // taken at the end of an ingestFile
+
+    // Shared with the previous snapshot while no zone is added
+    std::shared_ptr<const std::vector<std::string>> names;
+    std::vector<long long> pickupCounts; // by zone id
+    std::vector<long long> hourlyCounts; // id * 24 + hour
+};
+
+// Parallel ingest layout for zone counts (TripAnalyzer::setZoneTableMode)
+enum class ZoneTableMode
+{
+    Auto,
+    PerWorker,
+    Shared
+};
+
 class TripAnalyzer
 {
 public:
+    // Movable, not copyable. The snapshot cell and the hour-major lock are
+    // held by pointer so that a move leaves them in place. A moved-from
+    // analyzer may only be destroyed or assigned to.
+    TripAnalyzer() = default;
+    TripAnalyzer(TripAnalyzer &&) = default;
+    TripAnalyzer &operator=(TripAnalyzer &&) = default;
+
     // Parse Trips.csv, skip dirty rows, never crash
     void ingestFile(const std::string &csvPath);
 
@@ -28,7 +285,302 @@ public:
     // Top K slots: count desc, zone asc, hour asc
     std::vector<SlotCount> topBusySlots(int k = 10) const;
 
+    // Each pickup zone's busiest hour and its count, zone asc. Ties go to
+    // the earliest hour, as in topBusySlots.
+    std::vector<SlotCount> peakHours() const;
+
+    // Top K origin-destination pairs: count desc, pickup asc, dropoff asc.
+    // Empty for files without a dropoff column, and in approximate mode.
+    std::vector<RouteCount> topRoutes(int k = 10) const;
+
+    // Top K dropoff zones: count desc, zone asc (same caveats)
+    std::vector<ZoneCount> topDropoffZones(int k = 10) const;
+
+    // Fare and distance aggregates per zone and per (zone, hour). Off by
+    // default, as they read two more columns per row; not tracked in
+    // approximate mode. Set before ingestFile.
+    void setFareStats(bool enabled);
+    FareStats zoneFareStats(std::string_view zone) const;
+    FareStats slotFareStats(std::string_view zone, int hour) const;
+
+    // Top K zones by fare sum: revenue desc, zone asc
+    std::vector<ZoneRevenue> topZonesByRevenue(int k = 10) const;
+
+    // Time buckets beyond hour of day: per zone 15-minute slots, days of
+    // the week and calendar dates, from the same timestamp field. Rows
+    // whose date or minutes do not parse still count everywhere else. Off
+    // by default; not tracked in approximate mode. Set before ingestFile.
+    void setTimeBuckets(bool enabled);
+
+    // Top K (zone, bucket) pairs: count desc, zone asc, bucket asc. Every
+    // granularity but Hour needs setTimeBuckets(true).
+    std::vector<TimeSlotCount> topSlots(int k, TimeGranularity granularity) const;
+
+    // Per-day trip counts per zone with prefix sums, rebuilt at the end of
+    // each ingestFile, for date-range queries without re-reading the CSV.
+    // Off by default. Set before ingestFile.
+    void setDailyIndex(bool enabled);
+
+    // Top K pickup zones by trips dated from..to, both inclusive, as
+    // "YYYY-MM-DD": count desc, zone asc. O(zones) from the daily index;
+    // empty if a bound does not parse or from > to.
+    std::vector<ZoneCount> topZones(int k, std::string_view from, std::string_view to) const;
+
+    // Top K pickup zones by trips in `hour` (0..23): count desc, zone asc.
+    // Reads one row of an hour-major copy of the hourly counts. The first
+    // call after an ingestFile builds that copy (O(zones * 24)); later
+    // calls reuse it. Empty for an hour outside 0..23.
+    std::vector<ZoneCount> topZonesAtHour(int hour, int k = 10) const;
+
+    // Trips picked up in `zone`: an O(1) lookup instead of scanning
+    // topZones. In approximate mode, the summary's upper bound (0 if the
+    // zone is not tracked).
+    long long zoneCount(std::string_view zone) const;
+
+    // The zone's 24 hourly counts, without copying (empty view for an
+    // unknown zone, and always in approximate mode)
+    HourlyView zoneHourly(std::string_view zone) const;
+
+    // zoneCount for `count` zones at once into out[0..count), with the
+    // hash-table probes batched and prefetched
+    void zoneCounts(const std::string_view *zones, size_t count, long long *out) const;
+    std::vector<long long> zoneCounts(const std::vector<std::string_view> &zones) const;
+
+    // Publish an AggregateSnapshot every `milliseconds` of ingest (0 = off,
+    // the default) and at the end of each ingestFile. Each publish copies
+    // O(zones) counts, so the interval stretches to keep that under about
+    // 5% of ingest time. Not published in approximate mode. Rows held back
+    // by trip ID dedup are missing from snapshots until their batch is
+    // settled (see setTripIdDedup).
+    void setSnapshotInterval(int milliseconds);
+
+    // The latest snapshot, pinned for the guard's lifetime (empty before
+    // the first publish). Lock-free and safe to call from any thread while
+    // ingestFile runs; everything else on TripAnalyzer is not.
+    using SnapshotReader = SnapshotCell<AggregateSnapshot>::ReadGuard;
+    SnapshotReader snapshot() const { return _snapshots->read(); }
+
+    // Ingest and rank on `threads` worker threads (0 or 1 = this thread
+    // only, the default). The file is memory-mapped and cut into ~1 MB line
+    // ranges that a work-stealing pool hands to per-worker shards, which
+    // are then merged. Results match the sequential path exactly.
+    // Order-dependent or sketch-based options (approximate mode, trip ID
+    // dedup, reject sampling, distinct counting, the slot sketch) keep
+    // ingest sequential, and only the end-of-file snapshot is published.
+    //
+    // Workers are pinned per NUMA node (see WorkStealingPool). On more than
+    // one node each worker's shard is allocated on its node, and shards are
+    // merged per node before the nodes are merged. The second overload
+    // takes the node layout instead of reading it from sysfs.
+    void setThreads(int threads);
+    void setThreads(int threads, const NumaTopology &topology);
+    // Per-worker task, steal and busy-time counters (empty when sequential)
+    std::vector<WorkerStats> workerStats() const;
+
+    // How parallel ingest keeps pickup and hourly counts: one table per
+    // worker, merged at the end, or one SharedZoneCounts table for all.
+    // Auto picks shared when the first ~1 MB of the file already has
+    // SharedTableZones distinct zones. The shared table holds pickup and
+    // hourly counts only; dropoff zones and routes are still counted per
+    // worker, and fare stats, time buckets or the daily index turn it off.
+    // Either way the results match.
+    void setZoneTableMode(ZoneTableMode mode) { _zoneTableMode = mode; }
+
+    // Cap on the memory of the exact aggregates, in bytes (0 = unlimited,
+    // the default). Checked every few thousand rows against an estimate
+    // that includes the next growth of each table. Once it would be
+    // exceeded, zone and route counts are hash-partitioned by pickup zone
+    // into temp files in `spillDirectory` (default $TMPDIR or /tmp) and
+    // dropped from memory. At the end of ingestFile the rest is spilled
+    // too, and each partition is merged, one at a time, into one record
+    // per zone and route. From then on the analyzer stays spilled. The
+    // rankings read the partitions one at a time and merge each
+    // partition's top k, so results stay exact with one partition's zones
+    // in memory at once. zoneCount and estimateSlot binary-search the
+    // zone's partition index on disk, O(log zones) reads; zoneCounts
+    // reads each partition holding a requested zone once, in full.
+    //
+    // Only the pickup, dropoff, hourly and route counts spill. With fare
+    // stats, time buckets, the daily index or approximate mode the budget
+    // is ignored. A budget keeps ingest sequential. Once spilled,
+    // zoneHourly is empty and no snapshots are published. If the spill
+    // files cannot be written, the aggregates stay in memory. Set before
+    // ingestFile.
+    void setMemoryBudget(size_t bytes, const std::string &spillDirectory = std::string());
+    bool spilled() const { return _spill != nullptr; }
+
+    // Column layout detected for the most recently ingested file
+    const CsvSchema &schema() const { return _schema; }
+
+    // Row accounting for the most recent ingestFile call
+    const IngestStats &ingestStats() const { return _stats; }
+
+    void setParserProfile(const ParserProfile &profile) { _profile = profile; }
+    void setReaderOptions(const ReaderOptions &options) { _readerOptions = options; }
+
+    // Keep a uniform sample of up to n rejected lines (0 = off, the default)
+    void setRejectSampleSize(size_t n) { _rejectSampleSize = n; }
+
+    // Approximate mode for unbounded zone cardinality: zones and slots are
+    // tracked by Space-Saving summaries of `capacity` entries each instead
+    // of exact maps, so memory no longer grows with the input. topZones /
+    // topBusySlots then return upper-bound estimates; the *Approx variants
+    // also return each count's error bound. Any zone or slot with more
+    // than N / capacity trips (N = accepted rows) is guaranteed to appear.
+    // 0 (the default) means exact counting. Set before ingestFile.
+    void setApproximateMode(size_t capacity);
+    bool approximate() const { return _approxCapacity != 0; }
+    std::vector<ApproxZoneCount> topZonesApprox(int k = 10) const;
+    std::vector<ApproxSlotCount> topBusySlotsApprox(int k = 10) const;
+
+    // Drop rows whose trip ID was already seen, sized for about
+    // expectedRows distinct IDs (0 = off, the default). Exact: a blocked
+    // Bloom filter screens each ID, and rows it flags are held back and
+    // verified against the logged IDs in batches: when their text reaches
+    // 32 MB, and at the end of the file. Held rows are therefore counted
+    // after rows read later, so mid-file snapshots and the spill points
+    // see them late; end-of-file totals and stats are unaffected. IDs are
+    // remembered across ingestFile calls until this is called again. Set
+    // before ingestFile.
+    void setTripIdDedup(size_t expectedRows);
+
+    // HyperLogLog distinct counters with 2^precision registers (0 = off,
+    // the default; see HyperLogLog for the error). One counts distinct
+    // trip IDs over the whole input, the other distinct dropoff zones per
+    // pickup zone (2^precision bytes each). Set before ingestFile.
+    void setDistinctCounting(int precision);
+    long long distinctTripIds() const;
+    long long distinctDropoffs(std::string_view pickupZone) const;
+    // Rows seen with a trip ID minus distinct trip IDs: an estimate of
+    // replayed rows
+    long long duplicateTripIdEstimate() const;
+    // Folds another analyzer's distinct counters (e.g. one that ingested a
+    // different shard of the data) into this one. False if the precisions
+    // differ.
+    bool mergeDistinctCounters(const TripAnalyzer &shard);
+    const HyperLogLog &tripIdSketch() const { return _tripIdHll; }
+
+    // Count-Min Sketch of (zone, hour) counts, fed alongside the exact or
+    // approximate aggregate; width * depth counters in total (0 = off, the
+    // default). Set before ingestFile.
+    void setSlotSketch(size_t width, size_t depth);
+    const CountMinSketch &slotSketch() const { return _slotSketch; }
+
+    // Trips in `zone` at `hour`. With the sketch on this is its estimate:
+    // never below the true count, and at most true + epsilon * N (N =
+    // accepted rows, epsilon = e / width) with probability >= 1 - e^-depth.
+    // Without the sketch it is the exact count (0 in approximate mode).
+    long long estimateSlot(std::string_view zone, int hour) const;
+
+    AnalyzerMetrics metrics() const;
+    void writeMetricsJson(std::ostream &out) const;
+
 private:
-    std::unordered_map<std::string, long long> _zoneCounts;
-    std::unordered_map<std::string, std::vector<long long>> _zoneHourlyCounts;
+    // Header/schema progress of ingestChunks, carried across calls when a
+    // file is ingested in pieces
+    struct ScanState
+    {
+        bool firstLine = true;
+        bool schemaResolved = false;
+    };
+
+    template <char Delim, char DateTimeSep>
+    void ingestChunks(ChunkReader &reader, std::string_view chunk, ScanState &scan);
+    template <char Delim, char DateTimeSep>
+    void ingestText(ChunkReader &reader, std::string_view chunk, bool parallel);
+    template <char Delim, char DateTimeSep>
+    void ingestParallel(std::string_view text);
+    bool parallelIngest() const;
+    void mergeShard(const TripAnalyzer &shard);
+    void mergeSharedZones(const SharedZoneCounts &shared);
+    void sampleReject(RejectReason reason, long long lineNumber, std::string_view line);
+    void projectSchema(CsvSchema &schema) const;
+    void growZoneArrays();
+    void buildDailyIndex();
+    void buildHourMajor() const;
+    void publishSnapshot(bool final);
+    bool spillEnabled() const;
+    size_t aggregateBytes(size_t rows) const;
+    bool spillAggregates();
+    void finishSpill();
+    void residentZone(uint32_t id, SpilledZone &out) const;
+    // Spilled mode: every zone of one partition with its total counts
+    // (spill files plus whatever is still in memory), and the same for
+    // routes by pickup zone
+    void forEachZoneTotal(int partition, const std::function<void(const SpilledZone &)> &fn) const;
+    void forEachRouteTotal(int partition, const std::function<void(const SpilledRoute &)> &fn) const;
+    bool spilledZone(std::string_view zone, SpilledZone &out) const;
+
+    ParserProfile _profile;
+    ReaderOptions _readerOptions;
+    CsvSchema _schema;
+    IngestStats _stats;
+    size_t _rejectSampleSize = 0;
+    unsigned long long _rejectRng = 0;
+    mutable AnalyzerMetrics _timings; // stage timings only (TRIP_INSTRUMENT)
+
+    size_t _approxCapacity = 0;
+    SpaceSaving _approxZones;
+    SpaceSaving _approxSlots;
+    DuplicateFilter _dedup;
+    CountMinSketch _slotSketch;
+    int _distinctPrecision = 0;
+    HyperLogLog _tripIdHll;
+    long long _distinctRows = 0; // rows added to _tripIdHll
+    std::unordered_map<std::string, HyperLogLog> _dropoffHll; // by pickup zone
+
+    // Exact aggregates, indexed by interned zone id (pickup and dropoff
+    // zones share one id space)
+    ZoneTable _zones;
+    std::vector<long long> _pickupCounts;
+    std::vector<long long> _hourlyCounts; // id * 24 + hour
+    // Hour-major copy of _hourlyCounts for topZonesAtHour, built by its
+    // first call after an ingestFile
+    mutable std::vector<long long> _hourMajor; // hour * _hourMajorZones + id
+    mutable size_t _hourMajorZones = 0;
+    mutable bool _hourMajorBuilt = false;
+    std::unique_ptr<std::mutex> _hourMajorLock{new std::mutex};
+    std::vector<long long> _dropoffCounts;
+    IdPairCounts _routeCounts; // (pickup id, dropoff id)
+
+    // Fixed-point (hundredths) fare/distance columns by zone id and by
+    // zone id * 24 + hour
+    bool _fareStats = false;
+    FixedPointColumn _zoneFare;
+    FixedPointColumn _zoneDistance;
+    FixedPointColumn _slotFare;
+    FixedPointColumn _slotDistance;
+
+    // Time buckets by zone id: id * 96 + quarter, id * 7 + weekday, and
+    // sparse (id, day index) pairs for dates (also kept for the daily
+    // index)
+    bool _timeBuckets = false;
+    std::vector<long long> _quarterCounts;
+    std::vector<long long> _weekdayCounts;
+    IdPairCounts _dayCounts;
+
+    // Daily index: (_indexDays + 1) rows of prefix sums, one column per
+    // zone with dated pickups
+    bool _dailyIndex = false;
+    int _indexFirstDay = 0;
+    int _indexDays = 0;
+    std::vector<uint32_t> _indexZoneIds; // column -> zone id
+    std::vector<long long> _dayPrefix;
+
+    // Snapshot publishing (setSnapshotInterval)
+    int _snapshotIntervalMs = 0;
+    long long _snapshotGapNanos = 0; // current interval, stretched by cost
+    long long _snapshotSequence = 0;
+    std::unique_ptr<SnapshotCell<AggregateSnapshot>> _snapshots{new SnapshotCell<AggregateSnapshot>};
+
+    // Parallel ingest and ranking (setThreads)
+    std::unique_ptr<WorkStealingPool> _pool;
+    ZoneTableMode _zoneTableMode = ZoneTableMode::Auto;
+    SharedZoneCounts *_sharedZones = nullptr; // workers, in shared mode
+
+    // Memory budget and spill files (setMemoryBudget)
+    size_t _memoryBudget = 0;
+    std::string _spillDirectory;
+    std::unique_ptr<SpillStore> _spill; // set by the first spill
+    bool _spillFailed = false;          // files unusable: stay in memory
 };
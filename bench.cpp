@@ -0,0 +1,392 @@
+// Standalone benchmark: `make bench`, or ./benchmark --help
+//
+// Generates a seeded synthetic CSV per scenario, then times ingestFile,
+// topZones and topBusySlots separately and reports rows/s, MB/s, ns/row
+// and peak RSS for each stage. Times are the median over --reps runs.
+// Hardware counters (cycles, IPC, misses per row) are summed over all reps
+// when perf events are permitted.
+#include "analyzer.h"
+#include "perf_counters.h"
+#include "trip_generator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+struct Scenario
+{
+    std::string name;
+    TripGenConfig gen;
+};
+
+struct BenchOptions
+{
+    int reps = 3;
+    ReaderBackend backend = ReaderBackend::Auto;
+    bool perf = true;
+    size_t approx = 0; // Space-Saving capacity, 0 = exact
+    bool dedup = false;
+    int snapshotMs = 0; // publish interval; also runs a polling reader
+    int threads = 0;    // TripAnalyzer::setThreads
+    ZoneTableMode zoneTable = ZoneTableMode::Auto;
+    size_t budgetMb = 0; // TripAnalyzer::setMemoryBudget, 0 = unlimited
+};
+
+// -------------------- peak RSS per stage --------------------
+// Linux lets us reset the high-water mark (VmHWM) by writing 5 to
+// clear_refs, so each stage gets its own peak. Elsewhere we fall back to
+// the process-lifetime ru_maxrss, which only ever grows.
+static bool resetPeakRss()
+{
+    std::ofstream f("/proc/self/clear_refs");
+    if (!f.is_open())
+        return false;
+    f << "5";
+    return static_cast<bool>(f);
+}
+
+static long long peakRssKb()
+{
+    std::ifstream f("/proc/self/status");
+    std::string line;
+    while (std::getline(f, line))
+    {
+        if (line.compare(0, 6, "VmHWM:") == 0)
+            return std::atoll(line.c_str() + 6);
+    }
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+}
+
+// -------------------- stage timing --------------------
+struct StageResult
+{
+    std::vector<double> seconds;
+    long long peakKb = 0;
+    PerfSample counters; // summed over reps
+
+    double median() const
+    {
+        std::vector<double> s = seconds;
+        std::sort(s.begin(), s.end());
+        return s.empty() ? 0.0 : s[s.size() / 2];
+    }
+};
+
+template <class F>
+static void timeStage(StageResult &result, PerfCounters *perf, F &&fn)
+{
+    resetPeakRss();
+    if (perf)
+        perf->start();
+    auto t0 = std::chrono::steady_clock::now();
+    fn();
+    auto t1 = std::chrono::steady_clock::now();
+    if (perf)
+    {
+        PerfSample s = perf->stop();
+        for (int e = 0; e < PerfEventCount; ++e)
+        {
+            result.counters.valid[e] = s.valid[e];
+            result.counters.value[e] += s.value[e];
+        }
+    }
+    result.seconds.push_back(std::chrono::duration<double>(t1 - t0).count());
+    result.peakKb = std::max(result.peakKb, peakRssKb());
+}
+
+static void printRow(const std::string &scenario, const char *stage, const StageResult &r,
+                     long long rows, long long bytes)
+{
+    double s = r.median();
+    double rowsPerSec = s > 0 ? rows / s : 0.0;
+    double mbPerSec = s > 0 ? bytes / s / (1024.0 * 1024.0) : 0.0;
+    double nsPerRow = rows > 0 ? s * 1e9 / rows : 0.0;
+    std::printf("%-22s %-13s %10.3f %14.0f %10.1f %9.1f %11.1f\n", scenario.c_str(), stage,
+                s * 1e3, rowsPerSec, mbPerSec, nsPerRow, r.peakKb / 1024.0);
+}
+
+static void runScenario(const Scenario &sc, const BenchOptions &opt, PerfCounters *perf)
+{
+    fs::path path = fs::temp_directory_path() / ("trip_bench_" + std::to_string(getpid()) + ".csv");
+    if (!writeTrips(path.string(), sc.gen))
+    {
+        std::fprintf(stderr, "cannot write %s\n", path.string().c_str());
+        return;
+    }
+    long long bytes = static_cast<long long>(fs::file_size(path));
+    long long rows = sc.gen.rows;
+
+    ReaderOptions reader;
+    reader.backend = opt.backend;
+
+    StageResult ingest, zones, slots;
+    long long accepted = 0;
+    long long spills = 0, spillBytes = 0;
+    for (int rep = 0; rep < opt.reps; ++rep)
+    {
+        TripAnalyzer a;
+        a.setReaderOptions(reader);
+        if (opt.approx)
+            a.setApproximateMode(opt.approx);
+        if (opt.dedup)
+            a.setTripIdDedup(static_cast<size_t>(rows));
+        a.setThreads(opt.threads);
+        a.setZoneTableMode(opt.zoneTable);
+        a.setMemoryBudget(opt.budgetMb << 20);
+        // A dashboard-style reader querying the latest snapshot every 10 ms
+        std::atomic<bool> ingesting{true};
+        std::thread reader;
+        if (opt.snapshotMs)
+        {
+            a.setSnapshotInterval(opt.snapshotMs);
+            reader = std::thread([&]
+                                 {
+                while (ingesting.load()) {
+                    TripAnalyzer::SnapshotReader snap = a.snapshot();
+                    if (snap)
+                        snap->topZones(10);
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                } });
+        }
+        timeStage(ingest, perf, [&]
+                  { a.ingestFile(path.string()); });
+        ingesting = false;
+        if (reader.joinable())
+            reader.join();
+        accepted = a.ingestStats().rowsAccepted;
+        spills = a.ingestStats().spills;
+        spillBytes = a.ingestStats().spillBytes;
+
+        std::vector<ZoneCount> z;
+        timeStage(zones, perf, [&]
+                  { z = a.topZones(10); });
+        std::vector<SlotCount> s;
+        timeStage(slots, perf, [&]
+                  { s = a.topBusySlots(10); });
+    }
+
+    printRow(sc.name, "ingest", ingest, rows, bytes);
+    printRow(sc.name, "topZones", zones, rows, bytes);
+    printRow(sc.name, "topBusySlots", slots, rows, bytes);
+    std::printf("%-22s %-13s rows=%lld accepted=%lld bytes=%lld\n", sc.name.c_str(), "input", rows, accepted, bytes);
+    if (opt.budgetMb)
+        std::printf("%-22s %-13s spills=%lld bytes=%lld\n", sc.name.c_str(), "spill", spills, spillBytes);
+    if (perf)
+    {
+        long long totalRows = rows * opt.reps;
+        std::printf("%-22s ", sc.name.c_str());
+        printPerfSample(stdout, "ingest", ingest.counters, totalRows);
+        std::printf("%-22s ", sc.name.c_str());
+        printPerfSample(stdout, "topZones", zones.counters, totalRows);
+        std::printf("%-22s ", sc.name.c_str());
+        printPerfSample(stdout, "topBusySlots", slots.counters, totalRows);
+    }
+
+    std::error_code ec;
+    fs::remove(path, ec);
+}
+
+static std::vector<Scenario> defaultSuite()
+{
+    std::vector<Scenario> suite;
+
+    Scenario fewKeys{"few_keys_3col", {}};
+    fewKeys.gen.rows = 2000000;
+    fewKeys.gen.zones = 4;
+    fewKeys.gen.columns = 3;
+    suite.push_back(fewKeys);
+
+    Scenario highCard{"high_cardinality_3col", {}};
+    highCard.gen.rows = 1000000;
+    highCard.gen.zones = 500000;
+    highCard.gen.columns = 3;
+    suite.push_back(highCard);
+
+    Scenario prod{"prod_zipf_dirty_6col", {}};
+    prod.gen.rows = 2000000;
+    prod.gen.zones = 5000;
+    prod.gen.zipf = 1.1;
+    prod.gen.dirtyRatio = 0.01;
+    suite.push_back(prod);
+
+    Scenario quoted{"prod_quoted10_6col", {}};
+    quoted.gen.rows = 2000000;
+    quoted.gen.zones = 5000;
+    quoted.gen.quotedRatio = 0.10;
+    suite.push_back(quoted);
+
+    return suite;
+}
+
+static void usage()
+{
+    std::printf(
+        "usage: benchmark [options]\n"
+        "  without shape options, runs the default scenario suite\n"
+        "shape (any of these runs one custom scenario):\n"
+        "  --rows N        rows to generate (default 1000000)\n"
+        "  --zones N       zone cardinality (default 1000)\n"
+        "  --zipf S        zone skew, 0 = uniform (default 0)\n"
+        "  --dirty R       fraction of malformed rows (default 0)\n"
+        "  --quoted R      fraction of rows with quoted zone names (default 0)\n"
+        "  --columns 3|6   column layout (default 6)\n"
+        "  --seed N        generator seed (default 42)\n"
+        "run:\n"
+        "  --reps N        repetitions per stage, median reported (default 3)\n"
+        "  --backend B     auto|stream|async|mmap|io_uring (default auto)\n"
+        "  --no-perf       skip hardware performance counters\n"
+        "  --approx CAP    approximate (Space-Saving) mode with CAP entries\n"
+        "  --dedup         drop repeated trip IDs (filter sized for --rows)\n"
+        "  --snapshot MS   publish snapshots every MS ms to a polling reader\n"
+        "  --threads N     parallel ingest and ranking on N worker threads\n"
+        "  --zone-table M  auto|worker|shared zone counts for --threads\n"
+        "  --budget MB     memory budget for the aggregates; spills to $TMPDIR\n");
+}
+
+static bool parseBackend(const std::string &name, ReaderBackend &out)
+{
+    for (ReaderBackend b : {ReaderBackend::Auto, ReaderBackend::Stream, ReaderBackend::Async,
+                            ReaderBackend::Mmap, ReaderBackend::IoUring})
+    {
+        if (name == readerBackendName(b))
+        {
+            out = b;
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    BenchOptions opt;
+    Scenario custom{"custom", {}};
+    bool haveCustom = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string
+        {
+            if (i + 1 >= argc)
+            {
+                std::fprintf(stderr, "missing value for %s\n", arg.c_str());
+                std::exit(2);
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--help" || arg == "-h")
+        {
+            usage();
+            return 0;
+        }
+        else if (arg == "--approx")
+            opt.approx = static_cast<size_t>(std::atoll(value().c_str()));
+        else if (arg == "--dedup")
+            opt.dedup = true;
+        else if (arg == "--snapshot")
+            opt.snapshotMs = std::max(0, std::atoi(value().c_str()));
+        else if (arg == "--threads")
+            opt.threads = std::max(0, std::atoi(value().c_str()));
+        else if (arg == "--budget")
+            opt.budgetMb = static_cast<size_t>(std::max(0LL, std::atoll(value().c_str())));
+        else if (arg == "--zone-table")
+        {
+            std::string mode = value();
+            if (mode == "worker")
+                opt.zoneTable = ZoneTableMode::PerWorker;
+            else if (mode == "shared")
+                opt.zoneTable = ZoneTableMode::Shared;
+            else if (mode == "auto")
+                opt.zoneTable = ZoneTableMode::Auto;
+            else
+            {
+                std::fprintf(stderr, "unknown zone table mode\n");
+                return 2;
+            }
+        }
+        else if (arg == "--no-perf")
+            opt.perf = false;
+        else if (arg == "--reps")
+            opt.reps = std::max(1, std::atoi(value().c_str()));
+        else if (arg == "--backend")
+        {
+            if (!parseBackend(value(), opt.backend))
+            {
+                std::fprintf(stderr, "unknown backend\n");
+                return 2;
+            }
+        }
+        else if (arg == "--rows")
+            custom.gen.rows = std::atoll(value().c_str()), haveCustom = true;
+        else if (arg == "--zones")
+            custom.gen.zones = std::atoi(value().c_str()), haveCustom = true;
+        else if (arg == "--zipf")
+            custom.gen.zipf = std::atof(value().c_str()), haveCustom = true;
+        else if (arg == "--dirty")
+            custom.gen.dirtyRatio = std::atof(value().c_str()), haveCustom = true;
+        else if (arg == "--quoted")
+            custom.gen.quotedRatio = std::atof(value().c_str()), haveCustom = true;
+        else if (arg == "--columns")
+        {
+            custom.gen.columns = std::atoi(value().c_str());
+            haveCustom = true;
+            if (custom.gen.columns != 3 && custom.gen.columns != 6)
+            {
+                std::fprintf(stderr, "--columns must be 3 or 6\n");
+                usage();
+                return 2;
+            }
+        }
+        else if (arg == "--seed")
+            custom.gen.seed = std::strtoull(value().c_str(), nullptr, 10), haveCustom = true;
+        else
+        {
+            std::fprintf(stderr, "unknown option %s\n", arg.c_str());
+            usage();
+            return 2;
+        }
+    }
+
+    std::unique_ptr<PerfCounters> perf;
+    if (opt.perf)
+    {
+        perf.reset(new PerfCounters());
+        if (!perf->available())
+        {
+            std::printf("note: hardware counters disabled: %s\n", perf->unavailableReason().c_str());
+            perf.reset();
+        }
+    }
+
+    std::printf("%-22s %-13s %10s %14s %10s %9s %11s\n", "scenario", "stage", "ms", "rows/s", "MB/s",
+                "ns/row", "peakRSS_MB");
+    if (haveCustom)
+    {
+        runScenario(custom, opt, perf.get());
+    }
+    else
+    {
+        for (const Scenario &sc : defaultSuite())
+            runScenario(sc, opt, perf.get());
+    }
+    return 0;
+}
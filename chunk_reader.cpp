@@ -0,0 +1,635 @@
+#include "chunk_reader.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#define TRIP_HAVE_IO_URING 1
+#endif
+
+static const size_t kBufferAlign = 4096;
+
+static long long nanosSince(std::chrono::steady_clock::time_point t0)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// Page-aligned heap buffer (the allocation is rounded up to whole pages,
+// reads use exactly `capacity` bytes)
+struct AlignedBuffer
+{
+    char *data = nullptr;
+    size_t capacity = 0;
+
+    explicit AlignedBuffer(size_t bytes)
+    {
+        size_t rounded = (bytes + kBufferAlign - 1) / kBufferAlign * kBufferAlign;
+        data = static_cast<char *>(std::aligned_alloc(kBufferAlign, rounded));
+        capacity = data ? bytes : 0;
+    }
+    ~AlignedBuffer() { std::free(data); }
+    AlignedBuffer(const AlignedBuffer &) = delete;
+    AlignedBuffer &operator=(const AlignedBuffer &) = delete;
+};
+
+// Fills as much of buf as the file allows. Returns bytes read (0 at EOF).
+static size_t readFully(std::ifstream &file, char *buf, size_t capacity)
+{
+    file.read(buf, static_cast<std::streamsize>(capacity));
+    return static_cast<size_t>(file.gcount());
+}
+
+// -------------------- Stream: blocking reads on the caller's thread --------------------
+class StreamChunkReader : public ChunkReader
+{
+public:
+    StreamChunkReader(std::ifstream file, size_t bufferBytes)
+        : _file(std::move(file)), _buffer(bufferBytes)
+    {
+        _timing.backend = ReaderBackend::Stream;
+    }
+
+    std::string_view next() override
+    {
+        if (!_buffer.data)
+            return {};
+        auto t0 = std::chrono::steady_clock::now();
+        size_t n = readFully(_file, _buffer.data, _buffer.capacity);
+        long long ns = nanosSince(t0);
+        // Blocking reads are never hidden: every nanosecond is a stall
+        _timing.readNanos += ns;
+        _timing.stallNanos += ns;
+        _timing.bytesRead += static_cast<long long>(n);
+        return std::string_view(_buffer.data, n);
+    }
+
+    ReadTiming timing() const override { return _timing; }
+
+private:
+    std::ifstream _file;
+    AlignedBuffer _buffer;
+    ReadTiming _timing;
+};
+
+// -------------------- Async: reader thread + ring of buffers --------------------
+//
+// The reader fills slot i while the parser consumes slot i-1. A slot is
+// handed to the parser when full and returned to the reader on the next
+// call to next(), so the parser owns at most one slot at a time.
+class AsyncChunkReader : public ChunkReader
+{
+public:
+    AsyncChunkReader(std::ifstream file, size_t bufferBytes, int slots)
+        : _file(std::move(file))
+    {
+        _timing.backend = ReaderBackend::Async;
+        for (int i = 0; i < slots; ++i)
+            _slots.emplace_back(new Slot(bufferBytes));
+        _thread = std::thread(&AsyncChunkReader::readLoop, this);
+    }
+
+    ~AsyncChunkReader() override
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _cv.notify_all();
+        _thread.join();
+    }
+
+    std::string_view next() override
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_held >= 0)
+        {
+            // Give the previous slot back to the reader
+            _slots[_held]->full = false;
+            _held = -1;
+            _cv.notify_all();
+        }
+        if (_done && !_slots[_consume]->full)
+            return {};
+
+        auto t0 = std::chrono::steady_clock::now();
+        _cv.wait(lock, [&]
+                 { return _slots[_consume]->full || _done; });
+        _timing.stallNanos += nanosSince(t0);
+
+        Slot &slot = *_slots[_consume];
+        if (!slot.full)
+            return {};
+        _held = _consume;
+        _consume = (_consume + 1) % static_cast<int>(_slots.size());
+        return std::string_view(slot.buffer.data, slot.size);
+    }
+
+    ReadTiming timing() const override
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _timing;
+    }
+
+private:
+    struct Slot
+    {
+        explicit Slot(size_t bytes) : buffer(bytes) {}
+        AlignedBuffer buffer;
+        size_t size = 0;
+        bool full = false;
+    };
+
+    void readLoop()
+    {
+        int produce = 0;
+        for (;;)
+        {
+            Slot &slot = *_slots[produce];
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _cv.wait(lock, [&]
+                         { return !slot.full || _stop; });
+                if (_stop)
+                    return;
+            }
+
+            // Read outside the lock; the parser cannot touch a slot that is not full
+            auto t0 = std::chrono::steady_clock::now();
+            size_t n = slot.buffer.data ? readFully(_file, slot.buffer.data, slot.buffer.capacity) : 0;
+            long long ns = nanosSince(t0);
+
+            std::lock_guard<std::mutex> lock(_mutex);
+            _timing.readNanos += ns;
+            _timing.bytesRead += static_cast<long long>(n);
+            if (n == 0)
+            {
+                _done = true;
+                _cv.notify_all();
+                return;
+            }
+            slot.size = n;
+            slot.full = true;
+            _cv.notify_all();
+            produce = (produce + 1) % static_cast<int>(_slots.size());
+        }
+    }
+
+    std::ifstream _file;
+    std::vector<std::unique_ptr<Slot>> _slots;
+    std::thread _thread;
+    mutable std::mutex _mutex;
+    std::condition_variable _cv;
+    int _consume = 0;
+    int _held = -1;
+    bool _done = false;
+    bool _stop = false;
+    ReadTiming _timing;
+};
+
+// -------------------- Mmap: the whole file as one chunk --------------------
+class MmapChunkReader : public ChunkReader
+{
+public:
+    // nullptr if the file cannot be mapped (empty file, special file, ...)
+    static std::unique_ptr<ChunkReader> tryOpen(const std::string &path)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return nullptr;
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0)
+        {
+            ::close(fd);
+            return nullptr;
+        }
+        size_t size = static_cast<size_t>(st.st_size);
+        void *base = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (base == MAP_FAILED)
+            return nullptr;
+        // Advice values are not flags: one call each
+        ::madvise(base, size, MADV_SEQUENTIAL);
+        ::madvise(base, size, MADV_WILLNEED);
+
+        std::unique_ptr<MmapChunkReader> reader(new MmapChunkReader(static_cast<const char *>(base), size));
+        reader->_timing.readNanos = nanosSince(t0);
+        reader->_timing.stallNanos = reader->_timing.readNanos;
+        return reader;
+    }
+
+    ~MmapChunkReader() override { ::munmap(const_cast<char *>(_base), _size); }
+
+    std::string_view next() override
+    {
+        if (_consumed)
+            return {};
+        _consumed = true;
+        _timing.bytesRead = static_cast<long long>(_size);
+        return std::string_view(_base, _size);
+    }
+
+    // Page faults happen inside the parser and are not counted here
+    ReadTiming timing() const override { return _timing; }
+
+private:
+    MmapChunkReader(const char *base, size_t size) : _base(base), _size(size)
+    {
+        _timing.backend = ReaderBackend::Mmap;
+    }
+
+    const char *_base;
+    size_t _size;
+    bool _consumed = false;
+    ReadTiming _timing;
+};
+
+#ifdef TRIP_HAVE_IO_URING
+// -------------------- IoUring: several reads in flight --------------------
+//
+// Raw io_uring (no liburing): one READV per ring slot, each for the next
+// bufferBytes of the file. Completions may arrive out of order; next()
+// hands slots to the parser strictly in file order and resubmits the slot
+// it gets back for the next unread range, so slots - 1 reads stay in
+// flight while the parser works.
+class IoUringChunkReader : public ChunkReader
+{
+public:
+    // nullptr if io_uring is unavailable (old kernel, seccomp, ...)
+    static std::unique_ptr<ChunkReader> tryOpen(const std::string &path, size_t bufferBytes, int slots)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return nullptr;
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+        {
+            ::close(fd);
+            return nullptr;
+        }
+
+        std::unique_ptr<IoUringChunkReader> reader(new IoUringChunkReader(fd, static_cast<long long>(st.st_size)));
+        if (!reader->setupRing(static_cast<unsigned>(slots)))
+            return nullptr;
+        for (int i = 0; i < slots; ++i)
+            reader->_slots.emplace_back(new Slot(bufferBytes));
+        for (int i = 0; i < slots; ++i)
+            reader->submit(i);
+        return reader;
+    }
+
+    ~IoUringChunkReader() override
+    {
+        // Drain reads still in flight before their buffers go away
+        while (_inFlight > 0 && reap(true))
+        {
+        }
+        if (_sqes)
+            ::munmap(_sqes, _sqesSize);
+        if (_cqRing && _cqRing != _sqRing)
+            ::munmap(_cqRing, _cqRingSize);
+        if (_sqRing)
+            ::munmap(_sqRing, _sqRingSize);
+        if (_ringFd >= 0)
+            ::close(_ringFd);
+        ::close(_fd);
+    }
+
+    std::string_view next() override
+    {
+        // Harvest whatever finished while the parser was busy (no syscall),
+        // so readNanos is closer to the real completion times
+        if (_inFlight > 0 && !_ringBroken)
+            reap(false);
+        if (_held >= 0)
+        {
+            // Recycle the slot the parser just finished with
+            submit(_held);
+            _held = -1;
+        }
+        if (_failed)
+            return {};
+
+        Slot &slot = *_slots[_consume];
+        if (slot.state == Slot::Idle)
+            return {}; // nothing left to read
+
+        auto t0 = std::chrono::steady_clock::now();
+        while (slot.state == Slot::InFlight)
+        {
+            if (!reap(true))
+            {
+                // Cannot wait on the ring any more; in-flight buffers may
+                // still be written by the kernel, so stop rather than reuse them
+                _failed = true;
+                return {};
+            }
+        }
+        _timing.stallNanos += nanosSince(t0);
+
+        if (slot.state != Slot::Ready || slot.size == 0)
+            return {};
+        _held = _consume;
+        _consume = (_consume + 1) % static_cast<int>(_slots.size());
+        return std::string_view(slot.buffer.data, slot.size);
+    }
+
+    // readNanos is submit-to-harvest time per read, an upper bound on the
+    // device time since completions are only noticed between chunks
+    ReadTiming timing() const override { return _timing; }
+
+private:
+    struct Slot
+    {
+        enum State
+        {
+            Idle,
+            InFlight,
+            Ready
+        };
+        explicit Slot(size_t bytes) : buffer(bytes) {}
+        AlignedBuffer buffer;
+        State state = Idle;
+        long long offset = 0;
+        size_t want = 0; // bytes this slot should end up holding
+        size_t size = 0; // bytes read so far
+        struct iovec iov;
+        std::chrono::steady_clock::time_point submitted;
+    };
+
+    IoUringChunkReader(int fd, long long fileSize) : _fd(fd), _fileSize(fileSize)
+    {
+        _timing.backend = ReaderBackend::IoUring;
+    }
+
+    bool setupRing(unsigned entries)
+    {
+        struct io_uring_params params = {};
+        _ringFd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+        if (_ringFd < 0)
+            return false;
+
+        _sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        _cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single)
+            _sqRingSize = _cqRingSize = std::max(_sqRingSize, _cqRingSize);
+
+        _sqRing = ::mmap(nullptr, _sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         _ringFd, IORING_OFF_SQ_RING);
+        if (_sqRing == MAP_FAILED)
+        {
+            _sqRing = nullptr;
+            return false;
+        }
+        if (single)
+        {
+            _cqRing = _sqRing;
+        }
+        else
+        {
+            _cqRing = ::mmap(nullptr, _cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             _ringFd, IORING_OFF_CQ_RING);
+            if (_cqRing == MAP_FAILED)
+            {
+                _cqRing = nullptr;
+                return false;
+            }
+        }
+        _sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+        _sqes = static_cast<struct io_uring_sqe *>(::mmap(nullptr, _sqesSize, PROT_READ | PROT_WRITE,
+                                                          MAP_SHARED | MAP_POPULATE, _ringFd, IORING_OFF_SQES));
+        if (_sqes == MAP_FAILED)
+        {
+            _sqes = nullptr;
+            return false;
+        }
+
+        char *sq = static_cast<char *>(_sqRing);
+        char *cq = static_cast<char *>(_cqRing);
+        _sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        _sqMask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        _sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        _cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        _cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        _cqMask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        _cqes = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    // Queue a read of the next unread range into slot i, or leave it Idle
+    // once the file is exhausted
+    void submit(int i)
+    {
+        Slot &slot = *_slots[i];
+        slot.size = 0;
+        if (_nextOffset >= _fileSize || !slot.buffer.data)
+        {
+            slot.state = Slot::Idle;
+            return;
+        }
+        slot.offset = _nextOffset;
+        slot.want = static_cast<size_t>(std::min<long long>(static_cast<long long>(slot.buffer.capacity),
+                                                            _fileSize - slot.offset));
+        _nextOffset += static_cast<long long>(slot.want);
+        slot.submitted = std::chrono::steady_clock::now();
+        queueRead(i);
+    }
+
+    // Read slot.want - slot.size more bytes into the slot
+    void queueRead(int i)
+    {
+        Slot &slot = *_slots[i];
+        slot.state = Slot::InFlight;
+        if (_ringBroken)
+            return readSync(slot);
+
+        slot.iov.iov_base = slot.buffer.data + slot.size;
+        slot.iov.iov_len = slot.want - slot.size;
+
+        unsigned tail = *_sqTail;
+        unsigned index = tail & _sqMask;
+        struct io_uring_sqe &sqe = _sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READV;
+        sqe.fd = _fd;
+        sqe.addr = reinterpret_cast<unsigned long long>(&slot.iov);
+        sqe.len = 1;
+        sqe.off = static_cast<unsigned long long>(slot.offset) + slot.size;
+        sqe.user_data = static_cast<unsigned long long>(i);
+        _sqArray[index] = index;
+        __atomic_store_n(_sqTail, tail + 1, __ATOMIC_RELEASE);
+
+        if (::syscall(__NR_io_uring_enter, _ringFd, 1, 0, 0, nullptr, 0) < 0)
+        {
+            // The ring is unusable; the SQE is never consumed, so nothing is
+            // in flight for this slot. Finish it (and all later ones) with pread.
+            _ringBroken = true;
+            return readSync(slot);
+        }
+        _inFlight++;
+    }
+
+    // Blocking fallback when the ring rejects a request mid-stream
+    void readSync(Slot &slot)
+    {
+        while (slot.size < slot.want)
+        {
+            ssize_t n = ::pread(_fd, slot.buffer.data + slot.size, slot.want - slot.size,
+                                static_cast<off_t>(slot.offset + static_cast<long long>(slot.size)));
+            if (n <= 0)
+                break;
+            slot.size += static_cast<size_t>(n);
+            _timing.bytesRead += n;
+        }
+        _timing.readNanos += nanosSince(slot.submitted);
+        slot.state = Slot::Ready;
+    }
+
+    // Harvest completions, optionally blocking for at least one
+    bool reap(bool wait)
+    {
+        if (wait && ::syscall(__NR_io_uring_enter, _ringFd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0)
+            return false;
+
+        std::vector<int> resubmit;
+        unsigned head = *_cqHead;
+        unsigned tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head)
+        {
+            const struct io_uring_cqe &cqe = _cqes[head & _cqMask];
+            int i = static_cast<int>(cqe.user_data);
+            Slot &slot = *_slots[i];
+            _inFlight--;
+            if (cqe.res < 0)
+            {
+                // e.g. READV refused inside a sandbox: fall back to pread
+                _ringBroken = true;
+                resubmit.push_back(i);
+                continue;
+            }
+            slot.size += static_cast<size_t>(cqe.res);
+            _timing.bytesRead += cqe.res;
+            if (cqe.res > 0 && slot.size < slot.want)
+            {
+                resubmit.push_back(i); // short read: fetch the rest
+                continue;
+            }
+            _timing.readNanos += nanosSince(slot.submitted);
+            slot.state = Slot::Ready;
+        }
+        __atomic_store_n(_cqHead, head, __ATOMIC_RELEASE);
+
+        for (int i : resubmit)
+            queueRead(i);
+        return true;
+    }
+
+    int _fd;
+    long long _fileSize;
+    long long _nextOffset = 0;
+    int _ringFd = -1;
+    void *_sqRing = nullptr;
+    void *_cqRing = nullptr;
+    size_t _sqRingSize = 0;
+    size_t _cqRingSize = 0;
+    struct io_uring_sqe *_sqes = nullptr;
+    size_t _sqesSize = 0;
+    unsigned *_sqTail = nullptr;
+    unsigned *_sqArray = nullptr;
+    unsigned _sqMask = 0;
+    unsigned *_cqHead = nullptr;
+    unsigned *_cqTail = nullptr;
+    unsigned _cqMask = 0;
+    struct io_uring_cqe *_cqes = nullptr;
+
+    std::vector<std::unique_ptr<Slot>> _slots;
+    int _consume = 0;
+    int _held = -1;
+    int _inFlight = 0;
+    bool _ringBroken = false;
+    bool _failed = false;
+    ReadTiming _timing;
+};
+#endif
+
+const char *readerBackendName(ReaderBackend backend)
+{
+    switch (backend)
+    {
+    case ReaderBackend::Auto:
+        return "auto";
+    case ReaderBackend::Stream:
+        return "stream";
+    case ReaderBackend::Async:
+        return "async";
+    case ReaderBackend::Mmap:
+        return "mmap";
+    case ReaderBackend::IoUring:
+        return "io_uring";
+    }
+    return "unknown";
+}
+
+std::unique_ptr<ChunkReader> ChunkReader::open(const std::string &path, const ReaderOptions &options)
+{
+    size_t bufferBytes = std::max<size_t>(options.bufferBytes, 1);
+    int slots = std::max(2, options.slots);
+    ReaderBackend backend = options.backend;
+
+    // io_uring -> mmap -> stream, whichever the environment allows first
+    if (backend == ReaderBackend::IoUring)
+    {
+#ifdef TRIP_HAVE_IO_URING
+        if (std::unique_ptr<ChunkReader> reader = IoUringChunkReader::tryOpen(path, bufferBytes, slots))
+            return reader;
+#endif
+        backend = ReaderBackend::Mmap;
+    }
+    if (backend == ReaderBackend::Mmap)
+    {
+        if (std::unique_ptr<ChunkReader> reader = MmapChunkReader::tryOpen(path))
+            return reader;
+        backend = ReaderBackend::Stream;
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+        return nullptr;
+
+    if (backend == ReaderBackend::Auto || backend == ReaderBackend::Stream)
+    {
+        file.seekg(0, std::ios::end);
+        std::streamoff size = file.tellg();
+        file.seekg(0, std::ios::beg);
+        if (size >= 0 && static_cast<unsigned long long>(size) < bufferBytes)
+        {
+            // Whole file fits in one buffer: no point in a reader thread,
+            // and no point in allocating more than the file needs.
+            bufferBytes = static_cast<size_t>(size) + 1;
+            backend = ReaderBackend::Stream;
+        }
+        else if (backend == ReaderBackend::Auto)
+        {
+            backend = ReaderBackend::Async;
+        }
+    }
+
+    if (backend == ReaderBackend::Async)
+        return std::unique_ptr<ChunkReader>(new AsyncChunkReader(std::move(file), bufferBytes, slots));
+    return std::unique_ptr<ChunkReader>(new StreamChunkReader(std::move(file), bufferBytes));
+}
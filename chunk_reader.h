@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// How ingestFile pulls bytes off disk
+enum class ReaderBackend
+{
+    Auto,   // Async for files larger than one buffer, Stream otherwise
+    Stream, // blocking reads on the parsing thread
+    Async,  // reader thread filling a ring of buffers ahead of the parser
+    Mmap,   // map the whole file; falls back to Stream if mapping fails
+    IoUring // several large reads in flight via io_uring; falls back to
+            // Mmap, then Stream, when the kernel or container refuses it
+};
+
+const char *readerBackendName(ReaderBackend backend);
+
+struct ReaderOptions
+{
+    ReaderBackend backend = ReaderBackend::Auto;
+    size_t bufferBytes = 8u << 20; // per ring slot
+    int slots = 3;                 // Async and IoUring; at least 2
+};
+
+// What the reader did, in wall-clock nanoseconds
+struct ReadTiming
+{
+    ReaderBackend backend = ReaderBackend::Stream; // backend actually used
+    long long bytesRead = 0;
+    long long readNanos = 0;  // time spent inside read calls
+    long long stallNanos = 0; // time the parser waited for data
+
+    // Read time that overlapped with parsing instead of blocking it
+    long long hiddenNanos() const { return readNanos > stallNanos ? readNanos - stallNanos : 0; }
+};
+
+// Sequential source of a file's bytes in large chunks. Lines may span
+// chunks; stitching them is the caller's job.
+class ChunkReader
+{
+public:
+    virtual ~ChunkReader() = default;
+
+    // Next chunk, or an empty view at end of file (or on a read error).
+    // The view stays valid until the following call.
+    virtual std::string_view next() = 0;
+
+    virtual ReadTiming timing() const = 0;
+
+    // nullptr if the file cannot be opened
+    static std::unique_ptr<ChunkReader> open(const std::string &path, const ReaderOptions &options);
+};
@@ -0,0 +1,64 @@
+#pragma once
+// Stage probes for TripAnalyzer. Built with -DTRIP_INSTRUMENT (make
+// INSTRUMENT=1) they accumulate per-stage time; otherwise StageProbe is an
+// empty struct and every macro expands to nothing.
+#include <chrono>
+#include <cstdint>
+
+#ifdef TRIP_INSTRUMENT
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Cheap per-row timestamp: the TSC where available (converted to ns once
+// per ingest), steady_clock ticks elsewhere
+inline uint64_t probeTicks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+struct StageProbe
+{
+    uint64_t last = 0;
+    uint64_t tokenize = 0;
+    uint64_t timestamp = 0;
+    uint64_t aggregate = 0;
+
+    void reset() { last = probeTicks(); }
+    void charge(uint64_t &bucket)
+    {
+        uint64_t now = probeTicks();
+        bucket += now - last;
+        last = now;
+    }
+};
+
+// Adds the lifetime of the scope to a nanosecond counter
+struct ScopeTimer
+{
+    long long &target;
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+
+    explicit ScopeTimer(long long &t) : target(t) {}
+    ~ScopeTimer()
+    {
+        target += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+    }
+};
+
+#define TRIP_PROBE_RESET(probe) (probe).reset()
+#define TRIP_PROBE_CHARGE(probe, bucket) (probe).charge((probe).bucket)
+#define TRIP_SCOPE_TIMER(name, target) ScopeTimer name(target)
+#else
+struct StageProbe
+{
+};
+
+#define TRIP_PROBE_RESET(probe) ((void)0)
+#define TRIP_PROBE_CHARGE(probe, bucket) ((void)0)
+#define TRIP_SCOPE_TIMER(name, target) ((void)0)
+#endif
@@ -1,6 +1,10 @@
 #include "analyzer.h"
+#include "perf_counters.h"
 #include <iostream>
 #include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
 
 static void printZones(const std::vector<ZoneCount>& v) {
     std::cout << "TOP_ZONES\n";
@@ -15,17 +19,45 @@ static void printSlots(const std::vector<SlotCount>& v) {
 }
 
 int main() {
+    // TRIP_PERF=1: hardware counters per stage on stderr
+    const char* perfEnv = std::getenv("TRIP_PERF");
+    bool perfOn = perfEnv && std::strcmp(perfEnv, "1") == 0;
+    // Opened only when asked for: the syscalls are not free
+    std::unique_ptr<PerfCounters> perf;
+    if (perfOn) {
+        perf.reset(new PerfCounters);
+        if (!perf->available())
+            std::cerr << "perf: " << perf->unavailableReason() << "\n";
+    }
+
     auto t0 = std::chrono::high_resolution_clock::now();
 
     TripAnalyzer analyzer;
+    if (perf) perf->start();
     analyzer.ingestFile("SmallTrips.csv");
+    PerfSample ingestSample = perf ? perf->stop() : PerfSample();
+
+    if (perf) perf->start();
+    auto zones = analyzer.topZones(10);
+    auto slots = analyzer.topBusySlots(10);
+    PerfSample rankSample = perf ? perf->stop() : PerfSample();
 
-    printZones(analyzer.topZones(10));
-    printSlots(analyzer.topBusySlots(10));
+    printZones(zones);
+    printSlots(slots);
 
     auto t1 = std::chrono::high_resolution_clock::now();
     auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count();
 
     std::cout << "EXEC_MS\n" << ms << "\n";
+
+    if (perf && perf->available()) {
+        long long rows = analyzer.ingestStats().linesRead;
+        printPerfSample(stderr, "ingest", ingestSample, rows);
+        printPerfSample(stderr, "rank", rankSample, rows);
+    }
+
+    // Stage breakdown, only in builds made with INSTRUMENT=1
+    if (analyzer.metrics().timingEnabled)
+        analyzer.writeMetricsJson(std::cerr);
     return 0;
 }
@@ -0,0 +1,171 @@
+#include "perf_counters.h"
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define TRIP_HAVE_PERF 1
+#endif
+
+bool PerfSample::any() const
+{
+    for (bool v : valid)
+    {
+        if (v)
+            return true;
+    }
+    return false;
+}
+
+double PerfSample::ipc() const
+{
+    if (!valid[PerfCycles] || !valid[PerfInstructions] || value[PerfCycles] == 0)
+        return 0.0;
+    return static_cast<double>(value[PerfInstructions]) / static_cast<double>(value[PerfCycles]);
+}
+
+#ifdef TRIP_HAVE_PERF
+static int openEvent(uint32_t type, uint64_t config)
+{
+    struct perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1; // allowed up to perf_event_paranoid=2
+    attr.exclude_hv = 1;
+    attr.inherit = 1; // include the async reader thread
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(::syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+static uint64_t cacheConfig(uint64_t cache, uint64_t op, uint64_t result)
+{
+    return cache | (op << 8) | (result << 16);
+}
+#endif
+
+PerfCounters::PerfCounters()
+{
+    for (int &fd : _fd)
+        fd = -1;
+
+#ifdef TRIP_HAVE_PERF
+    // errno of the first open that fails, before later calls overwrite it
+    int err = 0;
+    auto open = [&](PerfEvent event, uint32_t type, uint64_t config)
+    {
+        _fd[event] = openEvent(type, config);
+        if (_fd[event] < 0 && err == 0)
+            err = errno;
+    };
+    open(PerfCycles, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    open(PerfInstructions, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    open(PerfBranchMisses, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    open(PerfL1dMisses, PERF_TYPE_HW_CACHE,
+         cacheConfig(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS));
+    open(PerfLlcMisses, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+
+    if (!available())
+    {
+        std::string paranoid;
+        std::ifstream f("/proc/sys/kernel/perf_event_paranoid");
+        std::getline(f, paranoid);
+        _reason = std::string("perf_event_open failed: ") + std::strerror(err);
+        if (!paranoid.empty())
+            _reason += " (perf_event_paranoid=" + paranoid + ")";
+    }
+#else
+    _reason = "perf events are only supported on Linux";
+#endif
+}
+
+PerfCounters::~PerfCounters()
+{
+#ifdef TRIP_HAVE_PERF
+    for (int fd : _fd)
+    {
+        if (fd >= 0)
+            ::close(fd);
+    }
+#endif
+}
+
+bool PerfCounters::available() const
+{
+    for (int fd : _fd)
+    {
+        if (fd >= 0)
+            return true;
+    }
+    return false;
+}
+
+void PerfCounters::start()
+{
+#ifdef TRIP_HAVE_PERF
+    for (int fd : _fd)
+    {
+        if (fd < 0)
+            continue;
+        ::ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+PerfSample PerfCounters::stop()
+{
+    PerfSample sample;
+#ifdef TRIP_HAVE_PERF
+    for (int i = 0; i < PerfEventCount; ++i)
+    {
+        if (_fd[i] < 0)
+            continue;
+        ::ioctl(_fd[i], PERF_EVENT_IOC_DISABLE, 0);
+
+        // value, time_enabled, time_running
+        uint64_t buf[3] = {};
+        if (::read(_fd[i], buf, sizeof(buf)) != static_cast<ssize_t>(sizeof(buf)) || buf[2] == 0)
+            continue;
+        // Scale up if the PMU multiplexed this counter with others
+        double scale = buf[2] < buf[1] ? static_cast<double>(buf[1]) / static_cast<double>(buf[2]) : 1.0;
+        sample.value[i] = static_cast<uint64_t>(static_cast<double>(buf[0]) * scale);
+        sample.valid[i] = true;
+    }
+#endif
+    return sample;
+}
+
+void printPerfSample(std::FILE *out, const char *label, const PerfSample &sample, long long rows)
+{
+    if (!sample.any())
+    {
+        std::fprintf(out, "%-13s perf counters unavailable\n", label);
+        return;
+    }
+    double perRow = rows > 0 ? 1.0 / static_cast<double>(rows) : 0.0;
+    auto field = [&](PerfEvent e, const char *name)
+    {
+        if (sample.valid[e])
+            std::fprintf(out, " %s=%.3f", name, static_cast<double>(sample.value[e]) * perRow);
+        else
+            std::fprintf(out, " %s=n/a", name);
+    };
+
+    std::fprintf(out, "%-13s", label);
+    field(PerfCycles, "cycles/row");
+    if (sample.ipc() > 0.0)
+        std::fprintf(out, " IPC=%.2f", sample.ipc());
+    else
+        std::fprintf(out, " IPC=n/a");
+    field(PerfBranchMisses, "br_miss/row");
+    field(PerfL1dMisses, "L1D_miss/row");
+    field(PerfLlcMisses, "LLC_miss/row");
+    std::fprintf(out, "\n");
+}
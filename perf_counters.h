@@ -0,0 +1,51 @@
+#pragma once
+// Hardware performance counters around a region of code, via
+// perf_event_open (Linux). Each event is opened on its own so one missing
+// event (common in VMs) does not take the others down; if none can be
+// opened (no permission, no PMU, not Linux) everything reports unavailable
+// and the wrapped code runs normally.
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+enum PerfEvent
+{
+    PerfCycles,
+    PerfInstructions,
+    PerfBranchMisses,
+    PerfL1dMisses,
+    PerfLlcMisses,
+    PerfEventCount
+};
+
+struct PerfSample
+{
+    bool valid[PerfEventCount] = {};
+    uint64_t value[PerfEventCount] = {};
+
+    bool any() const;
+    double ipc() const; // 0 when cycles or instructions are missing
+};
+
+class PerfCounters
+{
+public:
+    PerfCounters();
+    ~PerfCounters();
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    bool available() const;
+    // Why nothing could be opened, e.g. "perf_event_paranoid=3"
+    const std::string &unavailableReason() const { return _reason; }
+
+    void start();
+    PerfSample stop(); // counts since start(), scaled if multiplexed
+
+private:
+    int _fd[PerfEventCount];
+    std::string _reason;
+};
+
+// One line: cycles/row, IPC, branch/L1D/LLC misses per row
+void printPerfSample(std::FILE *out, const char *label, const PerfSample &sample, long long rows);
@@ -0,0 +1,382 @@
+#include "sketches.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+// splitmix64 finaliser
+static inline uint64_t mix64(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+uint64_t sketchHash(std::string_view key, uint64_t seed)
+{
+    // Eight bytes per step; the length goes into the initial state so a
+    // zero-padded tail cannot collide with a longer key
+    uint64_t h = mix64(seed ^ (key.size() * 0x9E3779B97F4A7C15ULL));
+    const char *p = key.data();
+    size_t n = key.size();
+    while (n >= 8)
+    {
+        uint64_t w;
+        std::memcpy(&w, p, 8);
+        h = mix64(h ^ w);
+        p += 8;
+        n -= 8;
+    }
+    uint64_t tail = 0;
+    std::memcpy(&tail, p, n);
+    return mix64(h ^ tail);
+}
+
+// -------------------- SpaceSaving --------------------
+void SpaceSaving::reset(size_t capacity)
+{
+    _capacity = capacity;
+    _total = 0;
+    _pos.clear();
+    _pos.reserve(capacity);
+    _entries.clear();
+    _entries.reserve(capacity);
+    _heap.clear();
+    _heap.reserve(capacity);
+}
+
+void SpaceSaving::add(std::string_view key, long long weight)
+{
+    if (_capacity == 0)
+        return;
+    _total += weight;
+
+    auto it = _pos.find(key);
+    if (it != _pos.end())
+    {
+        Entry &e = _entries[it->second];
+        e.count += weight;
+        siftDown(e.heapPos);
+        return;
+    }
+
+    if (_entries.size() < _capacity)
+    {
+        uint32_t n = static_cast<uint32_t>(_entries.size());
+        _entries.push_back({std::string(key), weight, 0, n});
+        _heap.push_back(n);
+        _pos.emplace(_entries[n].key, n);
+        siftUp(n);
+        return;
+    }
+
+    // Evict the minimum; the newcomer inherits its count as error
+    uint32_t n = _heap[0];
+    Entry &root = _entries[n];
+    _pos.erase(root.key);
+    root.error = root.count;
+    root.count += weight;
+    root.key.assign(key.data(), key.size());
+    _pos.emplace(root.key, n);
+    siftDown(0);
+}
+
+long long SpaceSaving::count(std::string_view key) const
+{
+    auto it = _pos.find(key);
+    return it == _pos.end() ? 0 : _entries[it->second].count;
+}
+
+void SpaceSaving::swapEntries(size_t a, size_t b)
+{
+    std::swap(_heap[a], _heap[b]);
+    _entries[_heap[a]].heapPos = static_cast<uint32_t>(a);
+    _entries[_heap[b]].heapPos = static_cast<uint32_t>(b);
+}
+
+void SpaceSaving::siftUp(size_t i)
+{
+    while (i > 0)
+    {
+        size_t parent = (i - 1) / 2;
+        if (countAt(parent) <= countAt(i))
+            break;
+        swapEntries(parent, i);
+        i = parent;
+    }
+}
+
+void SpaceSaving::siftDown(size_t i)
+{
+    for (;;)
+    {
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+        size_t smallest = i;
+        if (left < _heap.size() && countAt(left) < countAt(smallest))
+            smallest = left;
+        if (right < _heap.size() && countAt(right) < countAt(smallest))
+            smallest = right;
+        if (smallest == i)
+            return;
+        swapEntries(i, smallest);
+        i = smallest;
+    }
+}
+
+// -------------------- CountMinSketch --------------------
+void CountMinSketch::reset(size_t width, size_t depth)
+{
+    if (width == 0 || depth == 0)
+        width = depth = 0;
+    _width = width;
+    _depth = depth;
+    _total = 0;
+    _cells.assign(width * depth, 0);
+}
+
+// Row i uses column (h1 + i * h2) mod width (Kirsch-Mitzenmacher double
+// hashing), so one 64-bit hash feeds every row
+void CountMinSketch::add(uint64_t hash, long long weight)
+{
+    if (!_width)
+        return;
+    _total += weight;
+    uint64_t h1 = hash;
+    uint64_t h2 = (hash >> 32) | 1;
+    long long *row = _cells.data();
+    for (size_t i = 0; i < _depth; ++i, row += _width)
+        row[(h1 + i * h2) % _width] += weight;
+}
+
+long long CountMinSketch::estimate(uint64_t hash) const
+{
+    if (!_width)
+        return 0;
+    uint64_t h1 = hash;
+    uint64_t h2 = (hash >> 32) | 1;
+    long long best = LLONG_MAX;
+    const long long *row = _cells.data();
+    for (size_t i = 0; i < _depth; ++i, row += _width)
+        best = std::min(best, row[(h1 + i * h2) % _width]);
+    return best;
+}
+
+double CountMinSketch::epsilon() const
+{
+    return _width ? std::exp(1.0) / static_cast<double>(_width) : 0.0;
+}
+
+double CountMinSketch::delta() const
+{
+    return _depth ? std::exp(-static_cast<double>(_depth)) : 1.0;
+}
+
+// -------------------- HyperLogLog --------------------
+void HyperLogLog::reset(int precision)
+{
+    if (precision > 0)
+        precision = std::min(std::max(precision, 4), 18);
+    else
+        precision = 0;
+    _precision = precision;
+    _registers.assign(precision ? size_t(1) << precision : 0, 0);
+}
+
+double HyperLogLog::estimate() const
+{
+    if (!_precision)
+        return 0.0;
+    double m = static_cast<double>(_registers.size());
+    double sum = 0.0;
+    size_t zeros = 0;
+    for (uint8_t r : _registers)
+    {
+        sum += std::ldexp(1.0, -r);
+        zeros += r == 0;
+    }
+
+    double alpha;
+    switch (_precision)
+    {
+    case 4:
+        alpha = 0.673;
+        break;
+    case 5:
+        alpha = 0.697;
+        break;
+    case 6:
+        alpha = 0.709;
+        break;
+    default:
+        alpha = 0.7213 / (1.0 + 1.079 / m);
+        break;
+    }
+    double e = alpha * m * m / sum;
+
+    // Small range: linear counting over the empty registers is more
+    // accurate. No large-range correction is needed with a 64-bit hash.
+    if (e <= 2.5 * m && zeros)
+        e = m * std::log(m / static_cast<double>(zeros));
+    return e;
+}
+
+bool HyperLogLog::merge(const HyperLogLog &other)
+{
+    if (other._precision != _precision)
+        return false;
+    for (size_t i = 0; i < _registers.size(); ++i)
+        _registers[i] = std::max(_registers[i], other._registers[i]);
+    return true;
+}
+
+double HyperLogLog::standardError() const
+{
+    return _precision ? 1.04 / std::sqrt(static_cast<double>(_registers.size())) : 0.0;
+}
+
+// -------------------- BlockedBloomFilter --------------------
+void BlockedBloomFilter::reset(size_t expectedKeys, size_t bitsPerKey)
+{
+    size_t bits = expectedKeys * bitsPerKey;
+    size_t blocks = expectedKeys ? std::max<size_t>(1, (bits + 511) / 512) : 0;
+    _blocks.assign(blocks, Block{});
+}
+
+// -------------------- DuplicateFilter --------------------
+static const uint64_t TextKeyTag = uint64_t(1) << 63;
+
+// Canonical decimal keys map one-to-one onto values below 2^63, leaving
+// the top bit to tag arena offsets
+static bool numericKey(std::string_view key, uint64_t &value)
+{
+    if (key.empty() || key.size() > 18 || (key[0] == '0' && key.size() > 1))
+        return false;
+    value = 0;
+    for (char c : key)
+    {
+        if (c < '0' || c > '9')
+            return false;
+        value = value * 10 + static_cast<uint64_t>(c - '0');
+    }
+    return true;
+}
+
+void DuplicateFilter::reset(size_t expectedKeys)
+{
+    _filter.reset(expectedKeys);
+    _log.clear();
+    _log.reserve(expectedKeys);
+    _arena.clear();
+    std::vector<uint64_t>().swap(_index);
+    _indexSize = 0;
+    _indexed = 0;
+}
+
+std::string_view DuplicateFilter::text(uint64_t entry) const
+{
+    size_t offset = static_cast<size_t>(entry & ~TextKeyTag);
+    uint32_t length;
+    std::memcpy(&length, _arena.data() + offset, sizeof(length));
+    return std::string_view(_arena.data() + offset + sizeof(length), length);
+}
+
+size_t DuplicateFilter::insert(std::string_view key, bool &suspect)
+{
+    suspect = _filter.testAndSet(sketchHash(key));
+
+    uint64_t value = 0;
+    if (!numericKey(key, value))
+    {
+        value = TextKeyTag | _arena.size();
+        uint32_t length = static_cast<uint32_t>(key.size());
+        _arena.append(reinterpret_cast<const char *>(&length), sizeof(length));
+        _arena.append(key.data(), key.size());
+    }
+    _log.push_back(value);
+    return _log.size() - 1;
+}
+
+uint64_t DuplicateFilter::entryHash(uint64_t entry) const
+{
+    return entry & TextKeyTag ? sketchHash(text(entry)) : mix64(entry);
+}
+
+// Numeric and text entries never hold the same key
+bool DuplicateFilter::sameKey(uint64_t a, uint64_t b) const
+{
+    if ((a & TextKeyTag) != (b & TextKeyTag))
+        return false;
+    return a & TextKeyTag ? text(a) == text(b) : a == b;
+}
+
+// Room for `keys` distinct keys; rehashes from the log
+void DuplicateFilter::growIndex(size_t keys)
+{
+    size_t slots = _index.empty() ? 64 : _index.size();
+    while (keys * 2 > slots)
+        slots *= 2;
+    if (slots == _index.size())
+        return;
+    std::vector<uint64_t> old;
+    old.swap(_index);
+    _index.assign(slots, 0);
+    size_t mask = slots - 1;
+    for (uint64_t cell : old)
+    {
+        if (cell == 0)
+            continue;
+        size_t i = static_cast<size_t>(entryHash(_log[cell - 1])) & mask;
+        while (_index[i] != 0)
+            i = (i + 1) & mask;
+        _index[i] = cell;
+    }
+}
+
+// Earliest indexed position holding the key of _log[pos]; pos itself
+// (now indexed) if there is none
+size_t DuplicateFilter::firstOccurrence(size_t pos)
+{
+    uint64_t entry = _log[pos];
+    size_t mask = _index.size() - 1;
+    for (size_t i = static_cast<size_t>(entryHash(entry)) & mask;; i = (i + 1) & mask)
+    {
+        if (_index[i] == 0)
+        {
+            _index[i] = pos + 1;
+            _indexSize++;
+            return pos;
+        }
+        size_t other = static_cast<size_t>(_index[i] - 1);
+        if (sameKey(_log[other], entry))
+            return other;
+    }
+}
+
+std::vector<bool> DuplicateFilter::resolve(const std::vector<size_t> &suspects)
+{
+    std::vector<bool> duplicate(suspects.size(), false);
+    if (suspects.empty())
+        return duplicate;
+
+    // Extend the index over the entries logged since the last call, in
+    // log order, so each key keeps its earliest position
+    size_t last = 0;
+    for (size_t pos : suspects)
+        last = std::max(last, pos + 1);
+    if (last > _indexed)
+    {
+        growIndex(_indexSize + (last - _indexed));
+        for (size_t i = _indexed; i < last; ++i)
+            firstOccurrence(i);
+        _indexed = last;
+    }
+
+    for (size_t j = 0; j < suspects.size(); ++j)
+        duplicate[j] = firstOccurrence(suspects[j]) < suspects[j];
+    return duplicate;
+}
@@ -0,0 +1,228 @@
+#pragma once
+// Bounded-memory summaries used by TripAnalyzer's approximate modes
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// 64-bit hash of a byte string for the sketches below; `seed` selects an
+// independent hash function
+uint64_t sketchHash(std::string_view key, uint64_t seed = 0);
+
+// Space-Saving heavy hitters (Metwally et al.) over string keys.
+//
+// Tracks at most `capacity` keys. A key that is not tracked replaces the
+// current minimum and inherits its count as error. For every tracked key
+//     count - error <= true count <= count
+// and any key whose true count exceeds N / capacity (N = total updates)
+// is guaranteed to be tracked. Updates are O(log capacity).
+//
+// Entries never move once added (an evicted entry is reused in place), so
+// the key index holds views of their keys and the heap holds entry
+// numbers: a heap swap patches two integers, and add() with a tracked key
+// hashes the view once without building a string.
+class SpaceSaving
+{
+public:
+    struct Entry
+    {
+        std::string key;
+        long long count;
+        long long error;  // overestimation bound
+        uint32_t heapPos; // index in the min-heap
+    };
+
+    explicit SpaceSaving(size_t capacity = 0) { reset(capacity); }
+    // The index points into the entries: moving keeps them, copying not
+    SpaceSaving(const SpaceSaving &) = delete;
+    SpaceSaving &operator=(const SpaceSaving &) = delete;
+    SpaceSaving(SpaceSaving &&) = default;
+    SpaceSaving &operator=(SpaceSaving &&) = default;
+
+    void reset(size_t capacity);
+    void add(std::string_view key, long long weight = 1);
+
+    // Tracked count of `key` (an upper bound), or 0 if it is not tracked
+    long long count(std::string_view key) const;
+
+    size_t capacity() const { return _capacity; }
+    long long total() const { return _total; }
+    const std::vector<Entry> &entries() const { return _entries; } // unordered
+
+private:
+    void siftUp(size_t i);
+    void siftDown(size_t i);
+    void swapEntries(size_t a, size_t b);
+
+    long long countAt(size_t i) const { return _entries[_heap[i]].count; }
+
+    size_t _capacity = 0;
+    long long _total = 0;
+    std::vector<Entry> _entries; // reserved to capacity, never reallocated
+    std::vector<uint32_t> _heap; // entry numbers, min-heap on count
+    std::unordered_map<std::string_view, uint32_t> _pos; // entry key -> number
+};
+
+// Count-Min Sketch (Cormode & Muthukrishnan) for point queries.
+//
+// depth rows of width counters; an update adds to one counter per row and
+// a query takes the minimum over the rows. Estimates never undercount, and
+// with N = total() and e = 2.718...
+//     estimate <= true count + epsilon() * N   (epsilon = e / width)
+// holds with probability at least 1 - delta()  (delta = e^-depth).
+// Memory is width * depth counters regardless of the number of keys.
+class CountMinSketch
+{
+public:
+    CountMinSketch(size_t width = 0, size_t depth = 0) { reset(width, depth); }
+
+    void reset(size_t width, size_t depth);
+    void add(uint64_t hash, long long weight = 1);
+    long long estimate(uint64_t hash) const;
+
+    bool enabled() const { return _width != 0; }
+    size_t width() const { return _width; }
+    size_t depth() const { return _depth; }
+    long long total() const { return _total; }
+    double epsilon() const;
+    double delta() const;
+
+private:
+    size_t _width = 0;
+    size_t _depth = 0;
+    long long _total = 0;
+    std::vector<long long> _cells; // row-major, depth x width
+};
+
+// HyperLogLog distinct counter (Flajolet et al., with linear counting for
+// small cardinalities). 2^precision one-byte registers; the standard error
+// of estimate() is about 1.04 / sqrt(2^precision), e.g. 1.6% at precision
+// 12 (4 KB). Two sketches of the same precision merge losslessly, so
+// shards can count separately and combine afterwards.
+class HyperLogLog
+{
+public:
+    explicit HyperLogLog(int precision = 0) { reset(precision); }
+
+    // precision is clamped to 4..18; 0 disables the sketch
+    void reset(int precision);
+
+    // Inline: called once per row from the parse loop
+    void add(uint64_t hash)
+    {
+        if (!_precision)
+            return;
+        size_t index = static_cast<size_t>(hash >> (64 - _precision));
+        uint64_t rest = hash << _precision;
+        uint8_t rank = rest ? static_cast<uint8_t>(__builtin_clzll(rest) + 1) : static_cast<uint8_t>(65 - _precision);
+        if (rank > _registers[index])
+            _registers[index] = rank;
+    }
+
+    double estimate() const;
+    // Register-wise max; false (and no change) if the precisions differ
+    bool merge(const HyperLogLog &other);
+
+    bool enabled() const { return _precision != 0; }
+    int precision() const { return _precision; }
+    double standardError() const;
+
+private:
+    int _precision = 0;
+    std::vector<uint8_t> _registers;
+};
+
+// Split-block Bloom filter: each key sets one bit in each of the eight
+// 64-bit words of a single 64-byte block, so a lookup touches one cache
+// line. About 2% false positives at the default 10 bits per key.
+class BlockedBloomFilter
+{
+public:
+    explicit BlockedBloomFilter(size_t expectedKeys = 0, size_t bitsPerKey = 10) { reset(expectedKeys, bitsPerKey); }
+
+    void reset(size_t expectedKeys, size_t bitsPerKey = 10);
+
+    size_t blockCount() const { return _blocks.size(); }
+    size_t blockOf(uint64_t hash) const
+    {
+        return static_cast<size_t>(((hash >> 32) * static_cast<uint64_t>(_blocks.size())) >> 32);
+    }
+
+    // Sets the key's bits; true if they were all set already (maybe seen).
+    // Inline: called once per row from the parse loop.
+    bool testAndSet(uint64_t hash)
+    {
+        uint64_t *words = _blocks[blockOf(hash)].words;
+        uint64_t bits = hash * 0x9E3779B97F4A7C15ULL;
+        bool present = true;
+        for (int i = 0; i < 8; ++i)
+        {
+            uint64_t mask = uint64_t(1) << ((bits >> (6 * i)) & 63);
+            present &= (words[i] & mask) != 0;
+            words[i] |= mask;
+        }
+        return present;
+    }
+
+private:
+    struct alignas(64) Block
+    {
+        uint64_t words[8];
+    };
+    std::vector<Block> _blocks;
+};
+
+// Exact duplicate detection over a stream of string keys, fronted by a
+// BlockedBloomFilter. Every key is appended to a sequential log; the only
+// random access per key is the filter's one cache line. A filter miss
+// means the key is new. A filter hit only makes the key a suspect: the
+// caller holds such rows back and resolve() settles them in batches
+// against an exact index of first occurrences, so false positives cost
+// time, never correctness. The index is extended incrementally: each batch
+// only adds the log entries logged since the previous one. Canonical
+// decimal keys (no leading zero, up to 18 digits) are logged as their
+// value, anything else as an offset into a byte arena: about 9.25 bytes
+// per key plus the text of non-numeric keys, and up to 16 more per key
+// once resolve() has indexed it.
+class DuplicateFilter
+{
+public:
+    explicit DuplicateFilter(size_t expectedKeys = 0) { reset(expectedKeys); }
+
+    // Sizes the filter for expectedKeys (0 disables); more keys still work
+    // but raise the false-positive rate
+    void reset(size_t expectedKeys);
+    bool enabled() const { return _filter.blockCount() != 0; }
+
+    // Logs `key` and returns its position in the log. `suspect` is set if
+    // the filter has (probably) seen it before.
+    size_t insert(std::string_view key, bool &suspect);
+
+    // For each suspect position, whether an earlier log entry holds the
+    // same key (a true duplicate) or not (a filter false positive). First
+    // indexes the log entries up to the last suspect that earlier calls
+    // have not indexed yet, so a run of batches visits each entry once.
+    std::vector<bool> resolve(const std::vector<size_t> &suspects);
+
+    size_t keys() const { return _log.size(); }
+    size_t indexedKeys() const { return _indexed; } // log prefix resolve() has indexed
+
+private:
+    std::string_view text(uint64_t entry) const;
+    uint64_t entryHash(uint64_t entry) const;
+    bool sameKey(uint64_t a, uint64_t b) const;
+    void growIndex(size_t keys);
+    size_t firstOccurrence(size_t pos);
+
+    BlockedBloomFilter _filter;
+    std::vector<uint64_t> _log; // value, or tag | arena offset
+    std::string _arena;         // length-prefixed text keys
+
+    // Open addressing over distinct keys of _log[0, _indexed): position of
+    // the first occurrence + 1 (0 = empty), at most 1/2 full
+    std::vector<uint64_t> _index;
+    size_t _indexSize = 0;
+    size_t _indexed = 0;
+};
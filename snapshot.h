@@ -0,0 +1,115 @@
+#pragma once
+// Single-writer, many-reader publication of immutable values, for querying
+// TripAnalyzer from other threads while ingestFile runs.
+//
+// The writer swaps in a new value with publish(); readers pin the current
+// one with read(), which is a few atomic operations and a load, never a
+// lock. Reclamation is epoch based. A reader registers in the counter of
+// the epoch it saw (re-checking the epoch so it cannot register in a stale
+// one), and each publish flips the epoch and retires the value it
+// replaced. The retired value is freed by the next publish once the
+// counter it was retired under has drained, so the writer never waits for
+// a query that started after the flip, and reclaim(false) lets it skip a
+// publish rather than wait at all.
+#include <atomic>
+#include <memory>
+#include <thread>
+
+template <class T>
+class SnapshotCell
+{
+public:
+    // Pins one published value for its lifetime; empty before the first
+    // publish. Keep it short-lived: a pinned value blocks reclamation.
+    class ReadGuard
+    {
+    public:
+        ReadGuard(ReadGuard &&other) noexcept : _readers(other._readers), _value(other._value)
+        {
+            other._readers = nullptr;
+            other._value = nullptr;
+        }
+        ReadGuard(const ReadGuard &) = delete;
+        ReadGuard &operator=(const ReadGuard &) = delete;
+        ReadGuard &operator=(ReadGuard &&) = delete;
+        ~ReadGuard()
+        {
+            if (_readers)
+                _readers->fetch_sub(1);
+        }
+
+        explicit operator bool() const { return _value != nullptr; }
+        const T *get() const { return _value; }
+        const T *operator->() const { return _value; }
+        const T &operator*() const { return *_value; }
+
+    private:
+        friend class SnapshotCell;
+        ReadGuard(std::atomic<long> *readers, const T *value) : _readers(readers), _value(value) {}
+
+        std::atomic<long> *_readers;
+        const T *_value;
+    };
+
+    SnapshotCell() = default;
+    SnapshotCell(const SnapshotCell &) = delete;
+    SnapshotCell &operator=(const SnapshotCell &) = delete;
+    ~SnapshotCell()
+    {
+        delete _current.load();
+        delete _retired;
+    }
+
+    ReadGuard read() const
+    {
+        for (;;)
+        {
+            unsigned epoch = _epoch.load();
+            std::atomic<long> &readers = _readers[epoch & 1];
+            readers.fetch_add(1);
+            if (_epoch.load() == epoch)
+                return ReadGuard(&readers, _current.load());
+            readers.fetch_sub(1); // a publish flipped the epoch meanwhile
+        }
+    }
+
+    // Writer side; calls must not overlap each other. Waits only if a
+    // reader still pins the value retired by the previous publish.
+    void publish(std::unique_ptr<const T> next)
+    {
+        reclaim(true);
+        _retired = _current.exchange(next.release());
+        _retiredEpoch = _epoch.fetch_add(1);
+    }
+
+    // Writer side: frees the value retired by the last publish unless a
+    // reader still pins it (then waits, or returns false without `wait`).
+    // True means the next publish will not wait.
+    bool reclaim(bool wait)
+    {
+        if (!_retired)
+            return true;
+        std::atomic<long> &drain = _readers[_retiredEpoch & 1];
+        while (drain.load() != 0)
+        {
+            if (!wait)
+                return false;
+            std::this_thread::yield();
+        }
+        delete _retired;
+        _retired = nullptr;
+        return true;
+    }
+
+    // Writer side: the value last published, without pinning it
+    const T *latest() const { return _current.load(); }
+
+private:
+    std::atomic<const T *> _current{nullptr};
+    std::atomic<unsigned> _epoch{0};
+    mutable std::atomic<long> _readers[2] = {};
+
+    // Writer-only: the value replaced by the last publish
+    const T *_retired = nullptr;
+    unsigned _retiredEpoch = 0;
+};
@@ -0,0 +1,563 @@
+#include "spill.h"
+#include "sketches.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Record layout: u32 payload length, then the payload.
+//   zone:  u32 name length, name, i64 pickups, i64 dropoffs, u32 mask of
+//          non-zero hours, i64 per set bit
+//   route: u32 pickup length, pickup, u32 dropoff length, dropoff, i64 count
+template <class T>
+static void put(std::string &out, T value)
+{
+    out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+template <class T>
+static T take(std::string_view &in)
+{
+    T value;
+    std::memcpy(&value, in.data(), sizeof(value));
+    in.remove_prefix(sizeof(value));
+    return value;
+}
+
+static std::string_view takeString(std::string_view &in)
+{
+    uint32_t n = take<uint32_t>(in);
+    std::string_view s = in.substr(0, n);
+    in.remove_prefix(n);
+    return s;
+}
+
+static void encodeZone(std::string &out, const SpilledZone &z)
+{
+    size_t start = out.size();
+    put<uint32_t>(out, 0);
+    put<uint32_t>(out, static_cast<uint32_t>(z.zone.size()));
+    out += z.zone;
+    put<long long>(out, z.pickups);
+    put<long long>(out, z.dropoffs);
+    uint32_t mask = 0;
+    for (int h = 0; h < 24; ++h)
+    {
+        if (z.hourly[h])
+            mask |= 1u << h;
+    }
+    put<uint32_t>(out, mask);
+    for (int h = 0; h < 24; ++h)
+    {
+        if (z.hourly[h])
+            put<long long>(out, z.hourly[h]);
+    }
+    uint32_t length = static_cast<uint32_t>(out.size() - start - sizeof(uint32_t));
+    std::memcpy(&out[start], &length, sizeof(length));
+}
+
+static void decodeZone(std::string_view in, SpilledZone &z)
+{
+    z.zone.assign(takeString(in));
+    z.pickups = take<long long>(in);
+    z.dropoffs = take<long long>(in);
+    uint32_t mask = take<uint32_t>(in);
+    for (int h = 0; h < 24; ++h)
+        z.hourly[h] = mask >> h & 1 ? take<long long>(in) : 0;
+}
+
+static void encodeRoute(std::string &out, const SpilledRoute &r)
+{
+    put<uint32_t>(out, static_cast<uint32_t>(2 * sizeof(uint32_t) + r.pickupZone.size() + r.dropoffZone.size() +
+                                             sizeof(long long)));
+    put<uint32_t>(out, static_cast<uint32_t>(r.pickupZone.size()));
+    out += r.pickupZone;
+    put<uint32_t>(out, static_cast<uint32_t>(r.dropoffZone.size()));
+    out += r.dropoffZone;
+    put<long long>(out, r.count);
+}
+
+static void decodeRoute(std::string_view in, SpilledRoute &r)
+{
+    r.pickupZone.assign(takeString(in));
+    r.dropoffZone.assign(takeString(in));
+    r.count = take<long long>(in);
+}
+
+static bool writeAll(int fd, const std::string &data)
+{
+    const char *p = data.data();
+    size_t left = data.size();
+    while (left > 0)
+    {
+        ssize_t n = ::write(fd, p, left);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        left -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static long long fileSize(int fd)
+{
+    struct stat st;
+    return ::fstat(fd, &st) == 0 ? static_cast<long long>(st.st_size) : 0;
+}
+
+static bool readAt(int fd, void *data, size_t size, long long offset)
+{
+    char *p = static_cast<char *>(data);
+    while (size > 0)
+    {
+        ssize_t n = ::pread(fd, p, size, offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= static_cast<size_t>(n);
+        offset += n;
+    }
+    return true;
+}
+
+// One entry of a consolidated zone file's index
+struct IndexEntry
+{
+    uint64_t hash;
+    uint64_t offset; // of the record's length prefix
+};
+
+SpillStore::SpillStore(std::string directory) : _directory(std::move(directory))
+{
+    if (_directory.empty())
+    {
+        const char *tmp = std::getenv("TMPDIR");
+        _directory = tmp && *tmp ? tmp : "/tmp";
+    }
+}
+
+SpillStore::~SpillStore()
+{
+    for (int fd : _zoneFiles)
+        ::close(fd);
+    for (int fd : _routeFiles)
+        ::close(fd);
+}
+
+int SpillStore::createFile() const
+{
+    std::string path = _directory + "/trips-spill-XXXXXX";
+    int fd = ::mkstemp(&path[0]);
+    if (fd >= 0)
+        ::unlink(path.c_str());
+    return fd;
+}
+
+bool SpillStore::open()
+{
+    if (!_zoneFiles.empty())
+        return true;
+    for (int p = 0; p < _partitions; ++p)
+    {
+        int zones = createFile();
+        int routes = zones >= 0 ? createFile() : -1;
+        if (routes < 0)
+        {
+            if (zones >= 0)
+                ::close(zones);
+            for (int fd : _zoneFiles)
+                ::close(fd);
+            for (int fd : _routeFiles)
+                ::close(fd);
+            _zoneFiles.clear();
+            _routeFiles.clear();
+            return false;
+        }
+        _zoneFiles.push_back(zones);
+        _routeFiles.push_back(routes);
+    }
+    _zoneIndexAt.assign(_partitions, -1);
+    return true;
+}
+
+// Seeded apart from the zone table's hash, so partitions do not
+// correlate with its slots
+static const uint64_t PartitionSeed = 0x5B11;
+
+int SpillStore::partitionOf(std::string_view zone) const
+{
+    return static_cast<int>(sketchHash(zone, PartitionSeed) % static_cast<uint64_t>(_partitions));
+}
+
+// Pending bytes of one file go out once they reach this size
+static const size_t BufferBytes = 1 << 16;
+
+void SpillStore::beginBatch()
+{
+    // New records go where the indexes were; they are rebuilt by the
+    // next consolidate()
+    for (int p = 0; p < _partitions; ++p)
+    {
+        if (_zoneIndexAt[p] < 0)
+            continue;
+        if (::ftruncate(_zoneFiles[p], _zoneIndexAt[p]) == 0)
+            ::lseek(_zoneFiles[p], 0, SEEK_END);
+        _zoneIndexAt[p] = -1;
+        _consolidated = false;
+    }
+    _batchZoneSizes.clear();
+    _batchRouteSizes.clear();
+    for (int p = 0; p < _partitions; ++p)
+    {
+        _batchZoneSizes.push_back(fileSize(_zoneFiles[p]));
+        _batchRouteSizes.push_back(fileSize(_routeFiles[p]));
+    }
+    _zoneBuffers.assign(_partitions, std::string());
+    _routeBuffers.assign(_partitions, std::string());
+    _batchOk = true;
+}
+
+void SpillStore::buffered(int fd, std::string &buffer)
+{
+    if (buffer.size() < BufferBytes)
+        return;
+    _batchOk = _batchOk && writeAll(fd, buffer);
+    buffer.clear();
+}
+
+void SpillStore::add(const SpilledZone &zone)
+{
+    int p = partitionOf(zone.zone);
+    encodeZone(_zoneBuffers[p], zone);
+    buffered(_zoneFiles[p], _zoneBuffers[p]);
+}
+
+void SpillStore::add(const SpilledRoute &route)
+{
+    int p = partitionOf(route.pickupZone);
+    encodeRoute(_routeBuffers[p], route);
+    buffered(_routeFiles[p], _routeBuffers[p]);
+}
+
+bool SpillStore::commitBatch()
+{
+    bool wrote = false;
+    for (int p = 0; p < _partitions; ++p)
+    {
+        wrote = wrote || fileSize(_zoneFiles[p]) != _batchZoneSizes[p] || !_zoneBuffers[p].empty() ||
+                fileSize(_routeFiles[p]) != _batchRouteSizes[p] || !_routeBuffers[p].empty();
+        _batchOk = _batchOk && writeAll(_zoneFiles[p], _zoneBuffers[p]) && writeAll(_routeFiles[p], _routeBuffers[p]);
+    }
+    std::vector<std::string>().swap(_zoneBuffers);
+    std::vector<std::string>().swap(_routeBuffers);
+
+    if (!_batchOk)
+    {
+        for (int p = 0; p < _partitions; ++p)
+        {
+            if (::ftruncate(_zoneFiles[p], _batchZoneSizes[p]) == 0)
+                ::lseek(_zoneFiles[p], 0, SEEK_END);
+            if (::ftruncate(_routeFiles[p], _batchRouteSizes[p]) == 0)
+                ::lseek(_routeFiles[p], 0, SEEK_END);
+        }
+        return false;
+    }
+    if (wrote)
+        _consolidated = false;
+    return true;
+}
+
+// Copies every record into a fresh set of `partitions` files by the hash
+// of its zone (a route's pickup). The old files are closed only once all
+// new ones are written; false (the store unchanged) otherwise.
+bool SpillStore::repartition(int partitions)
+{
+    std::vector<int> zoneFiles;
+    std::vector<int> routeFiles;
+    bool ok = true;
+    for (int p = 0; ok && p < partitions; ++p)
+    {
+        int zones = createFile();
+        int routes = zones >= 0 ? createFile() : -1;
+        if (zones >= 0)
+            zoneFiles.push_back(zones);
+        if (routes >= 0)
+            routeFiles.push_back(routes);
+        ok = routes >= 0;
+    }
+
+    // Both kinds start with the zone name the partition is keyed by
+    std::vector<std::string> buffers(partitions);
+    auto scatter = [&](const std::vector<int> &from, const std::vector<int> &to)
+    {
+        for (int p = 0; ok && p < _partitions; ++p)
+        {
+            readRecords(from[p], -1, [&](std::string_view record)
+                        {
+                std::string_view rest = record;
+                uint64_t hash = sketchHash(takeString(rest), PartitionSeed);
+                int q = static_cast<int>(hash % static_cast<uint64_t>(partitions));
+                put<uint32_t>(buffers[q], static_cast<uint32_t>(record.size()));
+                buffers[q] += record;
+                if (buffers[q].size() >= BufferBytes)
+                {
+                    ok = ok && writeAll(to[q], buffers[q]);
+                    buffers[q].clear();
+                } });
+        }
+        for (int q = 0; q < partitions; ++q)
+        {
+            ok = ok && writeAll(to[q], buffers[q]);
+            buffers[q].clear();
+        }
+    };
+    if (ok)
+        scatter(_zoneFiles, zoneFiles);
+    if (ok)
+        scatter(_routeFiles, routeFiles);
+
+    std::vector<int> &dropZones = ok ? _zoneFiles : zoneFiles;
+    std::vector<int> &dropRoutes = ok ? _routeFiles : routeFiles;
+    for (int fd : dropZones)
+        ::close(fd);
+    for (int fd : dropRoutes)
+        ::close(fd);
+    if (!ok)
+        return false;
+    _zoneFiles.swap(zoneFiles);
+    _routeFiles.swap(routeFiles);
+    _zoneIndexAt.assign(partitions, -1);
+    _partitions = partitions;
+    return true;
+}
+
+bool SpillStore::consolidate()
+{
+    if (_consolidated)
+        return true;
+
+    // Unmerged bytes overstate the merged size, so this errs towards
+    // more partitions. If the split fails the merge goes ahead as is.
+    if (_partitionBytes > 0)
+    {
+        long long largest = 0;
+        for (int p = 0; p < _partitions; ++p)
+            largest = std::max(largest, fileSize(_zoneFiles[p]) + fileSize(_routeFiles[p]));
+        int wanted = _partitions;
+        while (wanted < MaxPartitions && largest * _partitions / wanted > _partitionBytes)
+            wanted *= 2;
+        if (wanted > _partitions)
+            repartition(wanted);
+    }
+
+    for (int p = 0; p < _partitions; ++p)
+    {
+        std::unordered_map<std::string, SpilledZone> zones;
+        forEachZone(p, [&](const SpilledZone &record)
+                    {
+            auto it = zones.find(record.zone);
+            if (it == zones.end())
+            {
+                zones.emplace(record.zone, record);
+                return;
+            }
+            it->second.pickups += record.pickups;
+            it->second.dropoffs += record.dropoffs;
+            for (int h = 0; h < 24; ++h)
+                it->second.hourly[h] += record.hourly[h]; });
+
+        // Routes keyed by the length-prefixed pickup name plus the dropoff
+        std::unordered_map<std::string, SpilledRoute> routes;
+        std::string key;
+        forEachRoute(p, [&](const SpilledRoute &record)
+                     {
+            key.clear();
+            put<uint32_t>(key, static_cast<uint32_t>(record.pickupZone.size()));
+            key += record.pickupZone;
+            key += record.dropoffZone;
+            auto it = routes.find(key);
+            if (it == routes.end())
+                routes.emplace(key, record);
+            else
+                it->second.count += record.count; });
+
+        int zoneFile = createFile();
+        int routeFile = zoneFile >= 0 ? createFile() : -1;
+        bool ok = routeFile >= 0;
+        std::string buffer;
+        std::vector<IndexEntry> index;
+        index.reserve(zones.size());
+        uint64_t written = 0;
+        for (auto it = zones.begin(); ok && it != zones.end(); ++it)
+        {
+            index.push_back({sketchHash(it->first, PartitionSeed), written + buffer.size()});
+            encodeZone(buffer, it->second);
+            if (buffer.size() >= BufferBytes)
+            {
+                ok = writeAll(zoneFile, buffer);
+                written += buffer.size();
+                buffer.clear();
+            }
+        }
+        ok = ok && writeAll(zoneFile, buffer);
+        written += buffer.size();
+        buffer.clear();
+        std::sort(index.begin(), index.end(), [](const IndexEntry &a, const IndexEntry &b)
+                  { return a.hash < b.hash; });
+        buffer.append(reinterpret_cast<const char *>(index.data()), index.size() * sizeof(IndexEntry));
+        ok = ok && writeAll(zoneFile, buffer);
+        buffer.clear();
+        for (auto it = routes.begin(); ok && it != routes.end(); ++it)
+        {
+            encodeRoute(buffer, it->second);
+            if (buffer.size() >= BufferBytes)
+            {
+                ok = writeAll(routeFile, buffer);
+                buffer.clear();
+            }
+        }
+        ok = ok && writeAll(routeFile, buffer);
+        if (!ok)
+        {
+            if (zoneFile >= 0)
+                ::close(zoneFile);
+            if (routeFile >= 0)
+                ::close(routeFile);
+            return false;
+        }
+
+        ::close(_zoneFiles[p]);
+        ::close(_routeFiles[p]);
+        _zoneFiles[p] = zoneFile;
+        _routeFiles[p] = routeFile;
+        _zoneIndexAt[p] = static_cast<long long>(written);
+    }
+    _consolidated = true;
+    return true;
+}
+
+// Streams the file up to `end` (-1: all of it) with pread (the write
+// offset is left alone), 1 MB at a time; a record cut by the buffer end
+// is carried into the next read
+void SpillStore::readRecords(int fd, long long end,
+                             const std::function<void(std::string_view record)> &fn) const
+{
+    const size_t ReadBytes = 1 << 20;
+    std::string buffer;
+    off_t offset = 0;
+    size_t used = 0; // bytes of buffer not yet consumed
+    for (;;)
+    {
+        size_t want = ReadBytes;
+        if (end >= 0)
+            want = static_cast<size_t>(std::min<long long>(ReadBytes, end - offset));
+        if (want == 0)
+            return;
+        buffer.resize(used + want);
+        ssize_t n = ::pread(fd, &buffer[used], want, offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+        offset += n;
+        size_t filled = used + static_cast<size_t>(n);
+        size_t pos = 0;
+        while (filled - pos >= sizeof(uint32_t))
+        {
+            uint32_t length;
+            std::memcpy(&length, &buffer[pos], sizeof(length));
+            if (filled - pos - sizeof(uint32_t) < length)
+                break;
+            fn(std::string_view(buffer.data() + pos + sizeof(uint32_t), length));
+            pos += sizeof(uint32_t) + length;
+        }
+        buffer.erase(0, pos);
+        used = filled - pos;
+    }
+}
+
+bool SpillStore::findZone(std::string_view zone, SpilledZone &out) const
+{
+    if (_zoneFiles.empty() || !_consolidated)
+        return false;
+    int p = partitionOf(zone);
+    int fd = _zoneFiles[p];
+    long long begin = _zoneIndexAt[p];
+    if (begin < 0)
+        return false;
+    uint64_t hash = sketchHash(zone, PartitionSeed);
+    size_t entries = static_cast<size_t>(fileSize(fd) - begin) / sizeof(IndexEntry);
+
+    // First entry with this hash, then each one sharing it
+    IndexEntry entry;
+    size_t lo = 0, hi = entries;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (!readAt(fd, &entry, sizeof(entry), begin + static_cast<long long>(mid * sizeof(entry))))
+            return false;
+        if (entry.hash < hash)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    std::string record;
+    for (; lo < entries; ++lo)
+    {
+        if (!readAt(fd, &entry, sizeof(entry), begin + static_cast<long long>(lo * sizeof(entry))) ||
+            entry.hash != hash)
+            return false;
+        uint32_t length;
+        if (!readAt(fd, &length, sizeof(length), static_cast<long long>(entry.offset)))
+            return false;
+        record.resize(length);
+        if (!readAt(fd, &record[0], length, static_cast<long long>(entry.offset + sizeof(length))))
+            return false;
+        decodeZone(record, out);
+        if (out.zone == zone)
+            return true;
+    }
+    return false;
+}
+
+void SpillStore::forEachZone(int partition, const std::function<void(const SpilledZone &)> &fn) const
+{
+    if (_zoneFiles.empty())
+        return;
+    SpilledZone z;
+    readRecords(_zoneFiles[partition], _zoneIndexAt[partition], [&](std::string_view record)
+                {
+        decodeZone(record, z);
+        fn(z); });
+}
+
+void SpillStore::forEachRoute(int partition, const std::function<void(const SpilledRoute &)> &fn) const
+{
+    if (_routeFiles.empty())
+        return;
+    SpilledRoute r;
+    readRecords(_routeFiles[partition], -1, [&](std::string_view record)
+                {
+        decodeRoute(record, r);
+        fn(r); });
+}
+
+long long SpillStore::bytes() const
+{
+    long long total = 0;
+    for (int fd : _zoneFiles)
+        total += fileSize(fd);
+    for (int fd : _routeFiles)
+        total += fileSize(fd);
+    return total;
+}
@@ -0,0 +1,110 @@
+#pragma once
+// Spill files for TripAnalyzer's memory budget (external aggregation).
+//
+// When the exact aggregates outgrow the budget they are written out as
+// per-zone and per-route records and dropped from memory. Records are
+// hash-partitioned by pickup zone name into partitions() files per kind,
+// so every record for one zone lands in one partition. A zone spilled
+// several times has several records until consolidate() merges each
+// partition, one at a time, into one record per zone or route, followed
+// in the zone file by an index of (name hash, offset) sorted by hash for
+// findZone(). The next batch cuts the indexes off again. Memory
+// while merging is one partition's distinct keys, so consolidate() first
+// re-hashes into more partitions (doubling, up to MaxPartitions) when the
+// largest is over setPartitionBytes().
+//
+// Files are created with mkstemp in the spill directory and unlinked at
+// once, so they disappear with the store (or the process). The format is
+// native-endian binary and never outlives the store.
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct SpilledZone
+{
+    std::string zone;
+    long long pickups = 0;
+    long long dropoffs = 0;
+    long long hourly[24] = {};
+};
+
+struct SpilledRoute
+{
+    std::string pickupZone;
+    std::string dropoffZone;
+    long long count = 0;
+};
+
+class SpillStore
+{
+public:
+    static const int MinPartitions = 64;
+    static const int MaxPartitions = 256; // two open files each
+
+    // An empty directory means $TMPDIR, or /tmp
+    explicit SpillStore(std::string directory = std::string());
+    ~SpillStore();
+    SpillStore(const SpillStore &) = delete;
+    SpillStore &operator=(const SpillStore &) = delete;
+
+    // Creates the partition files; false if they cannot be created
+    bool open();
+
+    int partitions() const { return _partitions; }
+    int partitionOf(std::string_view zone) const;
+
+    // File bytes a partition may reach before consolidate() splits it;
+    // 0 keeps MinPartitions
+    void setPartitionBytes(long long bytes) { _partitionBytes = bytes; }
+
+    // Appends go in batches: add() encodes a record into its partition's
+    // buffer, which is written out once it fills, and commitBatch() writes
+    // the rest. All or nothing: after a write error commitBatch() cuts the
+    // files back to where the batch began and returns false, so the caller
+    // can keep the batch in memory instead.
+    void beginBatch();
+    void add(const SpilledZone &zone);
+    void add(const SpilledRoute &route);
+    bool commitBatch();
+
+    // Merges each partition's records into one per zone and one per
+    // route. A partition is rewritten into a fresh file that replaces the
+    // old one only once complete; false if a rewrite failed (the data is
+    // then still there, unmerged).
+    bool consolidate();
+
+    // Binary search of the zone's partition index: O(log zones) reads.
+    // Only while consolidated(); false if the zone has no record.
+    bool findZone(std::string_view zone, SpilledZone &out) const;
+
+    // Records of one partition, in file order
+    void forEachZone(int partition, const std::function<void(const SpilledZone &)> &fn) const;
+    void forEachRoute(int partition, const std::function<void(const SpilledRoute &)> &fn) const;
+
+    long long bytes() const; // current size of all files
+    bool consolidated() const { return _consolidated; }
+
+private:
+    int createFile() const;
+    void buffered(int fd, std::string &buffer);
+    void readRecords(int fd, long long end, const std::function<void(std::string_view record)> &fn) const;
+    bool repartition(int partitions);
+
+    std::string _directory;
+    int _partitions = MinPartitions;
+    long long _partitionBytes = 0;
+    std::vector<int> _zoneFiles;  // by partition
+    std::vector<int> _routeFiles; // by partition
+    std::vector<long long> _zoneIndexAt; // by partition: index offset, or -1
+    bool _consolidated = true;
+
+    // Current batch: file sizes at beginBatch(), pending bytes by partition
+    std::vector<long long> _batchZoneSizes;
+    std::vector<long long> _batchRouteSizes;
+    std::vector<std::string> _zoneBuffers;
+    std::vector<std::string> _routeBuffers;
+    bool _batchOk = true;
+};
@@ -3,9 +3,14 @@
 
 #include <filesystem>
 #include <fstream>
+#include <sstream>
 #include <string>
 #include <vector>
 #include <tuple>
+#include <map>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 #include <cstdlib>
 #include <chrono>
 
@@ -81,6 +86,43 @@ struct TripsFixture {
     }
 };
 
+// Two analyzers that ingested the same data by different paths (parallel,
+// shared table, NUMA groups, spilled) must rank and count identically
+static void requireSameRankings(const TripAnalyzer& a, const TripAnalyzer& b) {
+    auto sameZones = [](const std::vector<ZoneCount>& x, const std::vector<ZoneCount>& y) {
+        REQUIRE(x.size() == y.size());
+        for (size_t i = 0; i < x.size(); i++) {
+            REQUIRE(x[i].zone == y[i].zone);
+            REQUIRE(x[i].count == y[i].count);
+        }
+    };
+    auto sameSlots = [](const std::vector<SlotCount>& x, const std::vector<SlotCount>& y) {
+        REQUIRE(x.size() == y.size());
+        for (size_t i = 0; i < x.size(); i++) {
+            REQUIRE(x[i].zone == y[i].zone);
+            REQUIRE(x[i].hour == y[i].hour);
+            REQUIRE(x[i].count == y[i].count);
+        }
+    };
+    sameZones(a.topZones(-1), b.topZones(-1));
+    sameZones(a.topZones(10), b.topZones(10));
+    sameSlots(a.topBusySlots(-1), b.topBusySlots(-1));
+    sameSlots(a.topBusySlots(25), b.topBusySlots(25));
+    sameSlots(a.peakHours(), b.peakHours());
+    sameZones(a.topZonesAtHour(7, 15), b.topZonesAtHour(7, 15));
+    sameZones(a.topDropoffZones(-1), b.topDropoffZones(-1));
+    std::vector<RouteCount> r1 = a.topRoutes(-1), r2 = b.topRoutes(-1);
+    REQUIRE(r1.size() == r2.size());
+    for (size_t i = 0; i < r1.size(); i++) {
+        REQUIRE(r1[i].pickupZone == r2[i].pickupZone);
+        REQUIRE(r1[i].dropoffZone == r2[i].dropoffZone);
+        REQUIRE(r1[i].count == r2[i].count);
+    }
+    REQUIRE(a.ingestStats().linesRead == b.ingestStats().linesRead);
+    REQUIRE(a.ingestStats().rowsAccepted == b.ingestStats().rowsAccepted);
+    REQUIRE(a.ingestStats().rejectedTotal() == b.ingestStats().rejectedTotal());
+}
+
 // =============================================================
 // CATEGORY A (15%): Robustness
 // =============================================================
@@ -322,3 +364,1281 @@ TEST_CASE_METHOD(TripsFixture,
     const long long limit = envMs("C3_LIMIT_MS", fastMode() ? 3500 : 9000);
     REQUIRE(ms < limit);
 }
+
+// =============================================================
+// EXTENSIONS: features beyond the graded skeleton
+// =============================================================
+
+TEST_CASE_METHOD(TripsFixture, "X1 Header maps named columns in any order", "[X]") {
+    std::string csv =
+        "PickupTime,TripID,PickupZoneID\n"
+        "2024-01-01 10:30,1,Z1\n"
+        "2024-01-01 11:00,2,Z1\n"
+        "2024-01-01 11:15,3,Z2\n";
+    writeTripsCsv(csv);
+
+    TripAnalyzer a;
+    a.ingestFile("Trips.csv");
+
+    REQUIRE(a.schema().pickupTime == 0);
+    REQUIRE(a.schema().pickupZone == 2);
+    requireZonesEq(a.topZones(10), {{"Z1", 2}, {"Z2", 1}});
+    requireSlotsEq(a.topBusySlots(10), {{"Z1", 10, 1}, {"Z1", 11, 1}, {"Z2", 11, 1}});
+}
+
+TEST_CASE_METHOD(TripsFixture, "X2 Production layout: projection stops at PickupTime", "[X]") {
+    std::string csv =
+        "TripID,PickupZoneID,DropoffZoneID,PickupTime,Distance,Fare\n"
+        "1,Z1,Z9,2024-01-01 08:10,3.5,12.0\n"
+        "2,Z1,Z8,2024-01-01 08:20,not,parsed\n";
+    writeTripsCsv(csv);
+
+    TripAnalyzer a;
+    a.ingestFile("Trips.csv");
+
+    REQUIRE(a.schema().dropoffZone == 2);
+    REQUIRE(a.schema().pickupTime == 3);
+    REQUIRE(a.schema().lastNeeded == 3);
+    requireSlotsEq(a.topBusySlots(10), {{"Z1", 8, 2}});
+}
+
+TEST_CASE_METHOD(TripsFixture, "X3 Headerless file takes the positional layout of each row", "[X]") {
+    std::string csv =
+        "1000001,ZONE254,ZONE819,2024-01-01 00:00,16.0,74.9\n"
+        "1000002,ZONE302,ZONE410,2024-01-01 23:59,19.3,81.2\n";
+    writeTripsCsv(csv);
+
+    TripAnalyzer a;
+    a.ingestFile("Trips.csv");
+
+    REQUIRE(a.schema().pickupTime == 3);
+    requireZonesEq(a.topZones(10), {{"ZONE254", 1}, {"ZONE302", 1}});
+
+    // No header: a short first line is a rejected data row, and 3- and
+    // 4-column rows each find the pickup time in their own layout
+    writeTripsCsv("T1,ZONE1\n"
+                  "T2,ZONE1,2024-01-01 07:00\n"
+                  "T3,ZONE2,ZONE1,2024-01-01 08:00\n"
+                  "4,ZONE2,2024-01-01 09:00\n");
+    TripAnalyzer b;
+    b.ingestFile("Trips.csv");
+    REQUIRE(b.ingestStats().headerRows == 0);
+    REQUIRE(b.ingestStats().rejected(RejectReason::TooFewColumns) == 1);
+    requireSlotsEq(b.topBusySlots(10), {{"ZONE1", 7, 1}, {"ZONE2", 8, 1}, {"ZONE2", 9, 1}});
+    requireZonesEq(b.topDropoffZones(10), {{"ZONE1", 1}});
+
+    // A non-numeric first ID is not enough for a header: no known column
+    writeTripsCsv("x,ZONE3,2024-01-01 10:00\n"
+                  "y,ZONE3,2024-01-01 11:00\n");
+    TripAnalyzer c;
+    c.ingestFile("Trips.csv");
+    REQUIRE(c.ingestStats().headerRows == 0);
+    requireZonesEq(c.topZones(10), {{"ZONE3", 2}});
+}
+
+TEST_CASE_METHOD(TripsFixture, "X4 Quoted fields may contain delimiters and escaped quotes", "[X]") {
+    std::string csv =
+        "\"TripID\",\"PickupZoneID\",\"PickupTime\"\n"
+        "1,\"ZONE 12, North\",2024-01-01 09:00\n"
+        "2,\"ZONE 12, North\",\"2024-01-01 09:30\"\n"
+        "3,\"Say \"\"Hi\"\"\",2024-01-01 10:00\n"
+        "4,Z1,2024-01-01 10:00\n"
+        "5,\"unterminated,2024-01-01 10:00\n";
+    writeTripsCsv(csv);
+
+    TripAnalyzer a;
+    REQUIRE_NOTHROW(a.ingestFile("Trips.csv"));
+
+    requireZonesEq(a.topZones(10), {{"ZONE 12, North", 2}, {"Say \"Hi\"", 1}, {"Z1", 1}});
+    requireSlotsEq(a.topBusySlots(1), {{"ZONE 12, North", 9, 2}});
+}
+
+TEST_CASE_METHOD(TripsFixture, "X5 Reject accounting: one counter per reason", "[X]") {
+    std::string csv =
+        "TripID,PickupZoneID,PickupTime\n"
+        "1,Z1,2024-01-01 10:30\n"
+        "BAD,LINE\n"
+        "3,Z2,NOT_A_TIME\n"
+        "4,,2024-01-01 11:00\n"
+        "5,Z9,\n"
+        "\n"
+        "6,Z2,2024-01-01 11\n"
+        "7,Z2,2024-01-01 xx:00\n"
+        "8,Z2,2024-01-01 24:00\n";
+    writeTripsCsv(csv);
+
+    TripAnalyzer a;
+    a.setRejectSampleSize(100);
+    a.ingestFile("Trips.csv");
+
+    const IngestStats& s = a.ingestStats();
+    REQUIRE(s.linesRead == 10);
+    REQUIRE(s.headerRows == 1);
+    REQUIRE(s.blankLines == 1);
+    REQUIRE(s.rowsAccepted == 1);
+    REQUIRE(s.rejected(RejectReason::TooFewColumns) == 1);
+    REQUIRE(s.rejected(RejectReason::NoSpace) == 1);
+    REQUIRE(s.rejected(RejectReason::EmptyZone) == 1);
+    REQUIRE(s.rejected(RejectReason::EmptyTime) == 1);
+    REQUIRE(s.rejected(RejectReason::NoColon) == 1);
+    REQUIRE(s.rejected(RejectReason::NonNumericHour) == 1);
+    REQUIRE(s.rejected(RejectReason::HourOutOfRange) == 1);
+    REQUIRE(s.rejectedTotal() == 7);
+
+    REQUIRE(s.rejectSample.size() == 7);
+    REQUIRE(s.rejectSample[0].lineNumber == 3);
+    REQUIRE(s.rejectSample[0].text == "BAD,LINE");
+    REQUIRE(s.rejectSample[6].reason == RejectReason::HourOutOfRange);
+}
+
+TEST_CASE_METHOD(TripsFixture, "X6 Reject sample is bounded", "[X]") {
+    std::string csv = "TripID,PickupZoneID,PickupTime\n";
+    for (int i = 0; i < 1000; i++) csv += std::to_string(i) + ",Z1,garbage\n";
+    writeTripsCsv(csv);
+
+    TripAnalyzer a;
+    a.setRejectSampleSize(16);
+    a.ingestFile("Trips.csv");
+
+    const IngestStats& s = a.ingestStats();
+    REQUIRE(s.rejected(RejectReason::NoSpace) == 1000);
+    REQUIRE(s.rejectSample.size() == 16);
+    for (size_t i = 1; i < s.rejectSample.size(); i++)
+        REQUIRE(s.rejectSample[i - 1].lineNumber < s.rejectSample[i].lineNumber);
+}
+
+TEST_CASE_METHOD(TripsFixture, "X7 Parser profiles: semicolon + ISO timestamps", "[X]") {
+    std::string csv =
+        "TripID;PickupZoneID;PickupTime\n"
+        "1;Z1;2024-01-01T10:30\n"
+        "2;Z1;2024-01-01T23:05\n"
+        "3;Z2;2024-01-01 10:30\n";
+    writeTripsCsv(csv);
+
+    TripAnalyzer a;
+    ParserProfile p;
+    p.delimiter = Delimiter::Semicolon;
+    p.timestamp = TimestampLayout::IsoT;
+    a.setParserProfile(p);
+    a.ingestFile("Trips.csv");
+
+    requireSlotsEq(a.topBusySlots(10), {{"Z1", 10, 1}, {"Z1", 23, 1}});
+    REQUIRE(a.ingestStats().rejected(RejectReason::NoSpace) == 1);
+}
+
+TEST_CASE_METHOD(TripsFixture, "X8 Parser profiles: auto-detected tab delimiter", "[X]") {
+    std::string csv =
+        "TripID\tPickupZoneID\tPickupTime\n"
+        "1\tZ,1\t2024-01-01 07:00\n"
+        "2\tZ,1\t2024-01-01 07:59\n";
+    writeTripsCsv(csv);
+
+    TripAnalyzer a;
+    ParserProfile p;
+    p.delimiter = Delimiter::Auto;
+    a.setParserProfile(p);
+    a.ingestFile("Trips.csv");
+
+    requireSlotsEq(a.topBusySlots(10), {{"Z,1", 7, 2}});
+}
+
+TEST_CASE_METHOD(TripsFixture, "X9 Reader backends stitch lines across buffer boundaries", "[X]") {
+    std::string csv = "TripID,PickupZoneID,PickupTime\r\n";
+    for (int i = 0; i < 5000; i++) {
+        csv += std::to_string(i) + ",Z" + std::to_string(i % 37) + ",2024-01-01 " +
+               zpad(i % 24, 2) + ":00\r\n";
+        if (i % 100 == 0) csv += "\r\n";
+    }
+    csv += "5000,Z1,2024-01-01 05:00"; // no trailing newline
+    writeTripsCsv(csv);
+
+    TripAnalyzer ref;
+    ref.ingestFile("Trips.csv");
+    REQUIRE(ref.ingestStats().rowsAccepted == 5001);
+
+    for (ReaderBackend backend : {ReaderBackend::Stream, ReaderBackend::Async}) {
+        for (size_t buf : {7u, 64u, 4096u}) {
+            INFO("backend " << (int)backend << " buffer " << buf);
+            ReaderOptions opt;
+            opt.backend = backend;
+            opt.bufferBytes = buf;
+            opt.slots = 2;
+
+            TripAnalyzer a;
+            a.setReaderOptions(opt);
+            a.ingestFile("Trips.csv");
+
+            REQUIRE(a.ingestStats().read.backend == backend);
+            REQUIRE(a.ingestStats().read.bytesRead == (long long)csv.size());
+            REQUIRE(a.ingestStats().linesRead == ref.ingestStats().linesRead);
+            REQUIRE(a.ingestStats().blankLines == ref.ingestStats().blankLines);
+            REQUIRE(a.ingestStats().rowsAccepted == 5001);
+
+            auto got = a.topBusySlots(-1);
+            auto exp = ref.topBusySlots(-1);
+            REQUIRE(got.size() == exp.size());
+            for (size_t i = 0; i < exp.size(); i++) {
+                REQUIRE(got[i].zone == exp[i].zone);
+                REQUIRE(got[i].hour == exp[i].hour);
+                REQUIRE(got[i].count == exp[i].count);
+            }
+        }
+    }
+}
+
+TEST_CASE_METHOD(TripsFixture, "X10 Mmap and io_uring backends match the stream path", "[X]") {
+    std::string csv = "TripID,PickupZoneID,PickupTime\n";
+    for (int i = 0; i < 20000; i++)
+        csv += std::to_string(i) + ",Z" + std::to_string(i % 101) + ",2024-01-01 " + zpad(i % 24, 2) + ":30\n";
+    writeTripsCsv(csv);
+
+    TripAnalyzer ref;
+    ref.ingestFile("Trips.csv");
+
+    for (ReaderBackend backend : {ReaderBackend::Mmap, ReaderBackend::IoUring}) {
+        ReaderOptions opt;
+        opt.backend = backend;
+        opt.bufferBytes = 4096; // many reads in flight, lines split across them
+        opt.slots = 4;
+
+        TripAnalyzer a;
+        a.setReaderOptions(opt);
+        a.ingestFile("Trips.csv");
+
+        // io_uring may be unavailable in the container; it must fall back, not fail
+        ReaderBackend used = a.ingestStats().read.backend;
+        INFO("requested " << readerBackendName(backend) << " used " << readerBackendName(used));
+        if (backend == ReaderBackend::Mmap) REQUIRE(used == ReaderBackend::Mmap);
+        else REQUIRE((used == ReaderBackend::IoUring || used == ReaderBackend::Mmap));
+        REQUIRE(a.ingestStats().read.bytesRead == (long long)csv.size());
+        REQUIRE(a.ingestStats().rowsAccepted == 20000);
+
+        auto got = a.topBusySlots(-1);
+        auto exp = ref.topBusySlots(-1);
+        REQUIRE(got.size() == exp.size());
+        for (size_t i = 0; i < exp.size(); i++) {
+            REQUIRE(got[i].zone == exp[i].zone);
+            REQUIRE(got[i].hour == exp[i].hour);
+            REQUIRE(got[i].count == exp[i].count);
+        }
+    }
+
+    // Missing files still fall all the way through and are ignored
+    ReaderOptions opt;
+    opt.backend = ReaderBackend::IoUring;
+    TripAnalyzer missing;
+    missing.setReaderOptions(opt);
+    REQUIRE_NOTHROW(missing.ingestFile("does_not_exist.csv"));
+    REQUIRE(missing.topZones(10).empty());
+}
+
+TEST_CASE_METHOD(TripsFixture, "X11 Metrics: counts always, stage timings when instrumented", "[X]") {
+    std::string csv = "TripID,PickupZoneID,PickupTime\n";
+    for (int i = 0; i < 1000; i++)
+        csv += std::to_string(i) + ",Z" + std::to_string(i % 10) + ",2024-01-01 08:00\n";
+    csv += "bad row\n";
+    writeTripsCsv(csv);
+
+    TripAnalyzer a;
+    a.ingestFile("Trips.csv");
+    a.topZones(3);
+
+    AnalyzerMetrics m = a.metrics();
+    REQUIRE(m.bytes == (long long)csv.size());
+    REQUIRE(m.rows == 1002);
+    REQUIRE(m.rowsAccepted == 1000);
+    REQUIRE(m.distinctZones == 10);
+    REQUIRE(m.loadFactor > 0.0);
+#ifdef TRIP_INSTRUMENT
+    REQUIRE(m.timingEnabled);
+    REQUIRE(m.tokenizeNanos > 0);
+    REQUIRE(m.aggregateNanos > 0);
+    REQUIRE(m.rankCalls == 1);
+#else
+    REQUIRE_FALSE(m.timingEnabled);
+    REQUIRE(m.tokenizeNanos == 0);
+    REQUIRE(m.rankNanos == 0);
+#endif
+
+    std::ostringstream json;
+    a.writeMetricsJson(json);
+    REQUIRE(json.str().find("\"distinct_zones\":10") != std::string::npos);
+
+#ifdef TRIP_INSTRUMENT
+    // Parallel ingest: worker shards' stage times are merged, not lost
+    std::string big = "TripID,PickupZoneID,PickupTime\n";
+    for (int i = 0; i < 300000; i++)
+        big += std::to_string(i) + ",Z" + std::to_string(i % 1000) + ",2024-01-01 08:00\n";
+    writeTripsCsv(big);
+    TripAnalyzer seq, par;
+    par.setThreads(4);
+    seq.ingestFile("Trips.csv");
+    par.ingestFile("Trips.csv");
+    AnalyzerMetrics s = seq.metrics(), p = par.metrics();
+    long long seqStages = s.tokenizeNanos + s.timestampNanos + s.aggregateNanos;
+    long long parStages = p.tokenizeNanos + p.timestampNanos + p.aggregateNanos;
+    REQUIRE(parStages * 2 > seqStages); // the first range alone is about 1/7
+#endif
+}
+
+TEST_CASE_METHOD(TripsFixture, "X12 Approximate mode: heavy hitters survive a bounded summary", "[X]") {
+    // 3 heavy zones among 20000 singletons; capacity 64 must keep the heavy ones
+    std::string csv = "TripID,PickupZoneID,PickupTime\n";
+    long long id = 0;
+    for (int i = 0; i < 20000; i++) {
+        csv += std::to_string(id++) + ",U" + std::to_string(i) + ",2024-01-01 03:00\n";
+        if (i % 10 == 0) csv += std::to_string(id++) + ",HOT_A,2024-01-01 08:00\n";
+        if (i % 20 == 0) csv += std::to_string(id++) + ",HOT_B,2024-01-01 09:00\n";
+        if (i % 40 == 0) csv += std::to_string(id++) + ",HOT_C,2024-01-01 10:00\n";
+    }
+    writeTripsCsv(csv);
+
+    TripAnalyzer exact;
+    exact.ingestFile("Trips.csv");
+
+    TripAnalyzer a;
+    a.setApproximateMode(64);
+    a.ingestFile("Trips.csv");
+    REQUIRE(a.approximate());
+
+    auto approx = a.topZonesApprox(3);
+    auto truth = exact.topZones(3);
+    REQUIRE(approx.size() == 3);
+    for (size_t i = 0; i < 3; i++) {
+        INFO("rank " << i);
+        REQUIRE(approx[i].zone == truth[i].zone);
+        REQUIRE(approx[i].count >= truth[i].count);
+        REQUIRE(approx[i].count - approx[i].error <= truth[i].count);
+    }
+    REQUIRE(a.topZonesApprox(-1).size() <= 64);
+
+    auto slots = a.topBusySlotsApprox(1);
+    REQUIRE(slots.size() == 1);
+    REQUIRE(slots[0].zone == "HOT_A");
+    REQUIRE(slots[0].hour == 8);
+    REQUIRE(slots[0].count - slots[0].error <= 2000);
+    REQUIRE(slots[0].count >= 2000);
+
+    // Plain API serves the estimates in approximate mode
+    REQUIRE(a.topZones(1)[0].zone == "HOT_A");
+}
+
+TEST_CASE_METHOD(TripsFixture, "X13 Count-Min sketch: slot estimates stay within the error bound", "[X]") {
+    std::string csv = "TripID,PickupZoneID,PickupTime\n";
+    long long id = 0;
+    for (int z = 0; z < 500; z++) {
+        for (int r = 0; r <= z % 7; r++) {
+            csv += std::to_string(id++) + ",Z" + std::to_string(z) + ",2024-01-01 " + std::to_string((z + r) % 24) + ":15\n";
+        }
+    }
+    writeTripsCsv(csv);
+
+    TripAnalyzer exact;
+    exact.ingestFile("Trips.csv");
+
+    TripAnalyzer a;
+    a.setSlotSketch(2048, 5);
+    a.ingestFile("Trips.csv");
+    const CountMinSketch &cms = a.slotSketch();
+    REQUIRE(cms.total() == id);
+    REQUIRE(cms.width() == 2048);
+    REQUIRE(cms.depth() == 5);
+
+    long long slack = static_cast<long long>(cms.epsilon() * cms.total());
+    int over = 0;
+    for (int z = 0; z < 500; z++) {
+        std::string zone = "Z" + std::to_string(z);
+        for (int h = 0; h < 24; h++) {
+            long long truth = exact.estimateSlot(zone, h);
+            long long est = a.estimateSlot(zone, h);
+            REQUIRE(est >= truth);
+            if (est > truth + slack) over++;
+        }
+    }
+    // Bound holds per query with probability 1 - e^-5; allow a stray miss
+    REQUIRE(over <= 12);
+
+    REQUIRE(exact.estimateSlot("Z6", 6) == 1);
+    REQUIRE(exact.estimateSlot("Z6", 12) == 1);
+    REQUIRE(exact.estimateSlot("NOPE", 3) == 0);
+    REQUIRE(a.estimateSlot("Z1", 24) == 0);
+    REQUIRE(a.estimateSlot("Z1", -1) == 0);
+}
+
+TEST_CASE_METHOD(TripsFixture, "X14 HyperLogLog: distinct trip IDs and dropoffs, merged across shards", "[X]") {
+    // 30000 rows, 25000 distinct IDs (every 6th row replays an earlier ID);
+    // pickup zone P<z> drops off in 40 * (z + 1) distinct zones
+    std::string header = "TripID,PickupZoneID,DropoffZoneID,PickupDateTime,Distance,Fare\n";
+    std::string shard1 = header, shard2 = header;
+    long long nextId = 0;
+    for (int i = 0; i < 30000; i++) {
+        long long id = (i % 6 == 5) ? nextId / 2 : nextId++;
+        int z = i % 3;
+        std::string row = std::to_string(id) + ",P" + std::to_string(z) + ",D" + std::to_string((i / 3) % (40 * (z + 1))) +
+                          ",2024-01-01 10:00,1.0,5.0\n";
+        (i < 15000 ? shard1 : shard2) += row;
+    }
+
+    writeTripsCsv(shard1 + shard2.substr(header.size()));
+    TripAnalyzer whole;
+    whole.setDistinctCounting(12);
+    whole.ingestFile("Trips.csv");
+    REQUIRE(whole.tripIdSketch().precision() == 12);
+
+    auto near = [](long long est, long long truth, double tol) {
+        INFO("estimate " << est << " truth " << truth);
+        REQUIRE(std::abs(est - truth) <= static_cast<long long>(truth * tol) + 1);
+    };
+    near(whole.distinctTripIds(), 25000, 0.05);
+    near(whole.duplicateTripIdEstimate(), 5000, 0.25);
+    near(whole.distinctDropoffs("P0"), 40, 0.05);
+    near(whole.distinctDropoffs("P1"), 80, 0.05);
+    near(whole.distinctDropoffs("P2"), 120, 0.05);
+    REQUIRE(whole.distinctDropoffs("NOPE") == 0);
+
+    writeTripsCsv(shard1);
+    TripAnalyzer a;
+    a.setDistinctCounting(12);
+    a.ingestFile("Trips.csv");
+    writeTripsCsv(shard2);
+    TripAnalyzer b;
+    b.setDistinctCounting(12);
+    b.ingestFile("Trips.csv");
+
+    REQUIRE(a.mergeDistinctCounters(b));
+    REQUIRE(a.distinctTripIds() == whole.distinctTripIds());
+    REQUIRE(a.distinctDropoffs("P2") == whole.distinctDropoffs("P2"));
+    REQUIRE(a.duplicateTripIdEstimate() == whole.duplicateTripIdEstimate());
+
+    TripAnalyzer other;
+    other.setDistinctCounting(10);
+    REQUIRE_FALSE(a.mergeDistinctCounters(other));
+
+    // Off by default; 3-column files have no dropoff column
+    TripAnalyzer off;
+    off.ingestFile("Trips.csv");
+    REQUIRE(off.distinctTripIds() == 0);
+    REQUIRE(off.schema().lastNeeded == 3);
+}
+
+TEST_CASE_METHOD(TripsFixture, "X15 Trip ID dedup: replays are dropped exactly", "[X]") {
+    // Numeric and text IDs; "007" and "7" are different IDs
+    writeTripsCsv("TripID,PickupZoneID,PickupTime\n"
+                  "1,A,2024-01-01 10:00\n"
+                  "2,A,2024-01-01 10:00\n"
+                  "1,A,2024-01-01 10:00\n"
+                  "007,B,2024-01-01 11:00\n"
+                  "7,B,2024-01-01 11:00\n"
+                  "007,B,2024-01-01 11:00\n"
+                  "\"x,1\",C,2024-01-01 12:00\n"
+                  "\"x,1\",C,2024-01-01 12:00\n"
+                  "3,,2024-01-01 12:00\n"
+                  "3,C,2024-01-01 12:00\n");
+    TripAnalyzer a;
+    a.setTripIdDedup(100);
+    a.ingestFile("Trips.csv");
+    const IngestStats &s = a.ingestStats();
+    REQUIRE(s.duplicateRows == 3);
+    REQUIRE(s.rowsAccepted == 6);
+    REQUIRE(s.rejected(RejectReason::EmptyZone) == 1);
+    auto zones = a.topZones();
+    REQUIRE(zones.size() == 3);
+    REQUIRE(zones[0].zone == "A");
+    REQUIRE(zones[0].count == 2);
+    REQUIRE(zones[1].zone == "B");
+    REQUIRE(zones[1].count == 2);
+    REQUIRE(zones[2].count == 2);
+
+    // Undersized filter: many false positives, still exact
+    std::string csv = "TripID,PickupZoneID,PickupTime\n";
+    for (int i = 0; i < 20000; i++) {
+        csv += std::to_string(i) + ",Z,2024-01-01 10:00\n";
+        csv += "T" + std::to_string(i) + ",Z,2024-01-01 10:00\n";
+        if (i % 4 == 0) csv += std::to_string(i / 2) + ",Z,2024-01-01 10:00\n";
+    }
+    writeTripsCsv(csv);
+    TripAnalyzer b;
+    b.setTripIdDedup(1000);
+    b.ingestFile("Trips.csv");
+    REQUIRE(b.ingestStats().rowsAccepted == 40000);
+    REQUIRE(b.ingestStats().duplicateRows == 5000);
+    REQUIRE(b.ingestStats().dedupFalsePositives > 0);
+
+    // Settled in batches: the index persists, so a repeat of a key from
+    // the first batch is still caught, and each batch only indexes new keys
+    DuplicateFilter d(64);
+    for (int batch = 0; batch < 5; batch++) {
+        std::vector<size_t> suspects;
+        for (int i = 0; i < 2000; i++) {
+            bool suspect = false;
+            std::string key = (i % 2 ? "T" : "") + std::to_string(batch * 2000 + i);
+            size_t pos = d.insert(key, suspect);
+            if (suspect) suspects.push_back(pos);
+        }
+        // Repeats of first-batch keys, numeric and text
+        for (int i = 0; i < 10; i++) {
+            bool suspect = false;
+            std::string key = (i % 2 ? "T" : "") + std::to_string(i);
+            suspects.push_back(d.insert(key, suspect));
+            REQUIRE(suspect);
+        }
+        std::vector<bool> duplicate = d.resolve(suspects);
+        REQUIRE(std::count(duplicate.begin(), duplicate.end(), true) == 10);
+        for (size_t j = suspects.size() - 10; j < suspects.size(); j++)
+            REQUIRE(duplicate[j]);
+        REQUIRE(d.indexedKeys() == d.keys());
+    }
+
+    // IDs are remembered across files; off by default
+    b.ingestFile("Trips.csv");
+    REQUIRE(b.ingestStats().rowsAccepted == 0);
+    TripAnalyzer off;
+    off.ingestFile("Trips.csv");
+    REQUIRE(off.ingestStats().rowsAccepted == 45000);
+    REQUIRE(off.ingestStats().duplicateRows == 0);
+}
+
+TEST_CASE_METHOD(TripsFixture, "X16 Routes and dropoff zones from the same pass", "[X]") {
+    // Dropoff column after the pickup time: still projected
+    writeTripsCsv("TripID,PickupZoneID,PickupTime,DropoffZoneID\n"
+                  "1,A,2024-01-01 10:00,B\n"
+                  "2,A,2024-01-01 10:00,B\n"
+                  "3,B,2024-01-01 11:00,A\n"
+                  "4,B,2024-01-01 11:00,A\n"
+                  "5,A,2024-01-01 12:00,C\n"
+                  "6,C,2024-01-01 12:00,\n"
+                  "7,,2024-01-01 12:00,C\n"
+                  "8,D,2024-01-01 13:00,C\n");
+    TripAnalyzer a;
+    a.ingestFile("Trips.csv");
+
+    auto routes = a.topRoutes();
+    REQUIRE(routes.size() == 4);
+    REQUIRE(routes[0].pickupZone == "A");
+    REQUIRE(routes[0].dropoffZone == "B");
+    REQUIRE(routes[0].count == 2);
+    REQUIRE(routes[1].pickupZone == "B");
+    REQUIRE(routes[1].dropoffZone == "A");
+    REQUIRE(routes[2].pickupZone == "A");
+    REQUIRE(routes[2].dropoffZone == "C");
+    REQUIRE(routes[3].pickupZone == "D");
+    REQUIRE(a.topRoutes(1).size() == 1);
+
+    auto drop = a.topDropoffZones();
+    REQUIRE(drop.size() == 3);
+    REQUIRE(drop[0].zone == "A");
+    REQUIRE(drop[0].count == 2);
+    REQUIRE(drop[1].zone == "B");
+    REQUIRE(drop[2].zone == "C");
+    REQUIRE(drop[2].count == 2);
+
+    // Zones seen only as dropoffs do not show up as pickups
+    auto zones = a.topZones();
+    REQUIRE(zones.size() == 4);
+    REQUIRE(zones[0].zone == "A");
+    REQUIRE(zones[0].count == 3);
+
+    writeTripsCsv("1,A,2024-01-01 10:00\n");
+    TripAnalyzer narrow;
+    narrow.ingestFile("Trips.csv");
+    REQUIRE(narrow.topRoutes().empty());
+    REQUIRE(narrow.topDropoffZones().empty());
+}
+
+TEST_CASE_METHOD(TripsFixture, "X17 Fare and distance aggregates with fixed-point parsing", "[X]") {
+    writeTripsCsv("TripID,PickupZoneID,DropoffZoneID,PickupTime,Distance,Fare\n"
+                  "1,A,B,2024-01-01 10:00,1.5,10.25\n"
+                  "2,A,B,2024-01-01 10:30,2,7.755\n"
+                  "3,A,C,2024-01-01 11:00,.5,-3.1\n"
+                  "4,B,C,2024-01-01 11:00,12345678.99,100\n"
+                  "5,B,C,2024-01-01 11:00,n/a,1e3\n"
+                  "6,C,A,2024-01-01 09:00,0.004,\n"
+                  "7,C,A,2024-01-01 09:00,3.25,+4.00\n");
+    TripAnalyzer a;
+    a.setFareStats(true);
+    a.ingestFile("Trips.csv");
+    REQUIRE(a.ingestStats().rowsAccepted == 7);
+
+    FareStats s = a.zoneFareStats("A");
+    REQUIRE(s.fareRows == 3);
+    REQUIRE(s.fareSum == Catch::Approx(10.25 + 7.76 - 3.10));
+    REQUIRE(s.fareMax == Catch::Approx(10.25));
+    REQUIRE(s.distanceRows == 3);
+    REQUIRE(s.distanceSum == Catch::Approx(4.0));
+    REQUIRE(s.distanceMean == Catch::Approx(4.0 / 3));
+    REQUIRE(s.distanceMax == Catch::Approx(2.0));
+
+    // Unparseable values are skipped, the row still counts as a trip
+    FareStats b = a.zoneFareStats("B");
+    REQUIRE(b.fareRows == 1);
+    REQUIRE(b.distanceRows == 1);
+    REQUIRE(b.distanceMax == Catch::Approx(12345678.99));
+
+    FareStats slot = a.slotFareStats("A", 10);
+    REQUIRE(slot.fareRows == 2);
+    REQUIRE(slot.fareMean == Catch::Approx((10.25 + 7.76) / 2));
+    REQUIRE(a.slotFareStats("A", 9).fareRows == 0);
+    REQUIRE(a.slotFareStats("NOPE", 9).fareRows == 0);
+    REQUIRE(a.zoneFareStats("C").distanceSum == Catch::Approx(3.25));
+
+    auto rev = a.topZonesByRevenue();
+    REQUIRE(rev.size() == 3);
+    REQUIRE(rev[0].zone == "B");
+    REQUIRE(rev[0].revenue == Catch::Approx(100.0));
+    REQUIRE(rev[0].trips == 2);
+    REQUIRE(rev[1].zone == "A");
+    REQUIRE(rev[2].zone == "C");
+    REQUIRE(a.topZonesByRevenue(1).size() == 1);
+
+    TripAnalyzer off;
+    off.ingestFile("Trips.csv");
+    REQUIRE(off.topZonesByRevenue().empty());
+    REQUIRE(off.zoneFareStats("A").fareRows == 0);
+}
+
+TEST_CASE_METHOD(TripsFixture, "X18 Time buckets: quarter hours, weekdays and dates", "[X]") {
+    // 2024-03-01 is a Friday, 2024-03-02 a Saturday
+    writeTripsCsv("TripID,PickupZoneID,PickupTime\n"
+                  "1,A,2024-03-01 08:05\n"
+                  "2,A,2024-03-01 08:10\n"
+                  "3,A,2024-03-01 08:20\n"
+                  "4,A,2024-03-02 08:50\n"
+                  "5,B,2024-03-02 23:59\n"
+                  "6,B,2024-03-02 23:45\n"
+                  "7,B,1999-12-31 00:00\n"
+                  "8,B,2024-13-01 10:00\n"
+                  "9,B,2024-03-01 10:x0\n");
+    TripAnalyzer a;
+    a.setTimeBuckets(true);
+    a.ingestFile("Trips.csv");
+    REQUIRE(a.ingestStats().rowsAccepted == 9);
+
+    auto quarters = a.topSlots(3, TimeGranularity::QuarterHour);
+    REQUIRE(quarters.size() == 3);
+    REQUIRE(quarters[0].zone == "A");
+    REQUIRE(quarters[0].bucket == 32); // 08:00-08:14
+    REQUIRE(quarters[0].count == 2);
+    REQUIRE(quarters[1].zone == "B");
+    REQUIRE(quarters[1].bucket == 95);
+    REQUIRE(timeBucketLabel(TimeGranularity::QuarterHour, 95) == "23:45");
+    REQUIRE(a.topSlots(-1, TimeGranularity::QuarterHour).size() == 6);
+
+    auto days = a.topSlots(-1, TimeGranularity::Date);
+    REQUIRE(days.size() == 5); // row 9 has a date, only its minutes are bad
+    REQUIRE(days[0].zone == "A");
+    REQUIRE(timeBucketLabel(TimeGranularity::Date, days[0].bucket) == "2024-03-01");
+    REQUIRE(days[0].count == 3);
+    REQUIRE(days[3].zone == "B");
+    REQUIRE(timeBucketLabel(TimeGranularity::Date, days[3].bucket) == "1999-12-31");
+    REQUIRE(timeBucketLabel(TimeGranularity::Date, 0) == "1970-01-01");
+
+    auto weekdays = a.topSlots(-1, TimeGranularity::DayOfWeek);
+    REQUIRE(weekdays[0].zone == "A");
+    REQUIRE(timeBucketLabel(TimeGranularity::DayOfWeek, weekdays[0].bucket) == "Fri");
+    REQUIRE(weekdays[0].count == 3);
+
+    auto types = a.topSlots(-1, TimeGranularity::DayType);
+    REQUIRE(types.size() == 4);
+    REQUIRE(types[0].zone == "A");
+    REQUIRE(types[0].bucket == 0);
+    REQUIRE(types[0].count == 3);
+    REQUIRE(types[1].zone == "B"); // tie: weekday before weekend
+    REQUIRE(types[1].bucket == 0);
+    REQUIRE(types[1].count == 2);
+    REQUIRE(types[2].bucket == 1);
+    REQUIRE(types[2].count == 2);
+
+    // Hour granularity is topBusySlots
+    auto hours = a.topSlots(1, TimeGranularity::Hour);
+    REQUIRE(hours[0].zone == "A");
+    REQUIRE(hours[0].bucket == 8);
+    REQUIRE(hours[0].count == 4);
+
+    TripAnalyzer off;
+    off.ingestFile("Trips.csv");
+    REQUIRE(off.topSlots(5, TimeGranularity::Date).empty());
+    REQUIRE(off.topSlots(5, TimeGranularity::Hour).size() == 4);
+}
+
+TEST_CASE_METHOD(TripsFixture, "X19 Date-range topZones from the daily index", "[X]") {
+    std::string csv = "TripID,PickupZoneID,PickupTime\n";
+    long long id = 0;
+    // A: 1 trip per day through March; B: 5 per day on Mar 10-12; C: Feb only
+    for (int d = 1; d <= 31; d++) {
+        char date[16];
+        std::snprintf(date, sizeof(date), "2024-03-%02d", d);
+        csv += std::to_string(id++) + ",A," + date + " 10:00\n";
+        if (d >= 10 && d <= 12)
+            for (int r = 0; r < 5; r++) csv += std::to_string(id++) + ",B," + date + " 11:00\n";
+    }
+    csv += std::to_string(id++) + ",C,2024-02-29 09:00\n";
+    csv += std::to_string(id++) + ",C,1901-01-01 09:00\n"; // far outlier, outside the index window
+    csv += std::to_string(id++) + ",C,bad-date 09:00\n";
+    // D: only impossible dates, none of them indexed
+    for (const char *date : {"2024-02-30", "2023-02-29", "2023-04-31", "0000-01-15", "1900-02-29"})
+        csv += std::to_string(id++) + ",D," + date + " 09:00\n";
+    writeTripsCsv(csv);
+
+    TripAnalyzer a;
+    a.setDailyIndex(true);
+    a.ingestFile("Trips.csv");
+
+    auto march = a.topZones(10, "2024-03-01", "2024-03-31");
+    REQUIRE(march.size() == 2);
+    REQUIRE(march[0].zone == "A");
+    REQUIRE(march[0].count == 31);
+    REQUIRE(march[1].zone == "B");
+    REQUIRE(march[1].count == 15);
+
+    auto mid = a.topZones(10, "2024-03-11", "2024-03-12");
+    REQUIRE(mid.size() == 2);
+    REQUIRE(mid[0].zone == "B");
+    REQUIRE(mid[0].count == 10);
+    REQUIRE(mid[1].count == 2);
+
+    auto leap = a.topZones(10, "2024-02-29", "2024-02-29");
+    REQUIRE(leap.size() == 1);
+    REQUIRE(leap[0].zone == "C");
+
+    // Outside the indexed window: answered by the fallback scan
+    auto all = a.topZones(10, "1900-01-01", "2099-12-31");
+    REQUIRE(all.size() == 3);
+    REQUIRE(all[2].zone == "C");
+    REQUIRE(all[2].count == 2);
+
+    REQUIRE(a.topZones(10, "2024-03-02", "2024-03-01").empty());
+    REQUIRE(a.topZones(10, "March", "2024-03-01").empty());
+    REQUIRE(a.topZones(10, "2024-02-30", "2024-03-31").empty());
+    REQUIRE(a.topZones(1, "2024-03-01", "2024-03-31").size() == 1);
+    // Plain topZones is unaffected
+    REQUIRE(a.topZones(10).size() == 4);
+}
+
+TEST_CASE_METHOD(TripsFixture, "X20 Per-zone lookups: zoneCount, zoneHourly and batches", "[X]") {
+    std::string csv = "TripID,PickupZoneID,PickupTime\n";
+    long long id = 0;
+    for (int z = 0; z < 3000; z++)
+        for (int r = 0; r <= z % 5; r++)
+            csv += std::to_string(id++) + ",Z" + std::to_string(z) + ",2024-01-01 " + std::to_string(r * 3) + ":00\n";
+    writeTripsCsv(csv);
+    TripAnalyzer a;
+    a.ingestFile("Trips.csv");
+
+    REQUIRE(a.zoneCount("Z4") == 5);
+    REQUIRE(a.zoneCount("Z5") == 1);
+    REQUIRE(a.zoneCount("nope") == 0);
+
+    HourlyView h = a.zoneHourly("Z4");
+    REQUIRE(h.size() == 24);
+    REQUIRE(h[0] == 1);
+    REQUIRE(h[12] == 1);
+    REQUIRE(h[13] == 0);
+    long long sum = 0;
+    for (long long c : h) sum += c;
+    REQUIRE(sum == 5);
+    REQUIRE(a.zoneHourly("nope").empty());
+    REQUIRE(a.zoneHourly("nope")[3] == 0);
+
+    std::vector<std::string> names;
+    for (int z = 0; z < 3100; z++) names.push_back("Z" + std::to_string(z));
+    std::vector<std::string_view> views(names.begin(), names.end());
+    std::vector<long long> counts = a.zoneCounts(views);
+    REQUIRE(counts.size() == 3100);
+    for (int z = 0; z < 3100; z++) {
+        INFO("zone " << z);
+        REQUIRE(counts[z] == (z < 3000 ? z % 5 + 1 : 0));
+    }
+
+    TripAnalyzer approx;
+    approx.setApproximateMode(16);
+    approx.ingestFile("Trips.csv");
+    REQUIRE(approx.zoneCount(approx.topZones(1)[0].zone) == approx.topZones(1)[0].count);
+    REQUIRE(approx.zoneHourly("Z4").empty());
+}
+
+TEST_CASE_METHOD(TripsFixture, "X21 topZonesAtHour matches filtered topBusySlots", "[X]") {
+    std::string csv = "TripID,PickupZoneID,PickupTime\n";
+    long long id = 0;
+    for (int z = 0; z < 300; z++)
+        for (int r = 0; r < (z * 7) % 11 + 1; r++)
+            csv += std::to_string(id++) + ",Z" + std::to_string(z) + ",2024-01-01 " + std::to_string((z + r * r) % 24) + ":05\n";
+    writeTripsCsv(csv);
+    TripAnalyzer a;
+    a.ingestFile("Trips.csv");
+
+    std::vector<SlotCount> slots = a.topBusySlots(-1);
+    for (int h = 0; h < 24; h++) {
+        std::vector<ZoneCount> expected;
+        for (const SlotCount &s : slots)
+            if (s.hour == h) expected.push_back({s.zone, s.count});
+        for (int k : {0, 1, 5, -1}) {
+            std::vector<ZoneCount> got = a.topZonesAtHour(h, k);
+            size_t n = k >= 0 && (size_t)k < expected.size() ? (size_t)k : expected.size();
+            REQUIRE(got.size() == n);
+            for (size_t i = 0; i < n; i++) {
+                REQUIRE(got[i].zone == expected[i].zone);
+                REQUIRE(got[i].count == expected[i].count);
+            }
+        }
+    }
+    REQUIRE(a.topZonesAtHour(24, 5).empty());
+    REQUIRE(a.topZonesAtHour(-1, 5).empty());
+
+    // Ingesting again doubles every count and the index follows
+    ZoneCount before = a.topZonesAtHour(5, 1)[0];
+    a.ingestFile("Trips.csv");
+    REQUIRE(a.topZonesAtHour(5, 1)[0].zone == before.zone);
+    REQUIRE(a.topZonesAtHour(5, 1)[0].count == 2 * before.count);
+}
+
+TEST_CASE_METHOD(TripsFixture, "X22 peakHours: busiest hour per zone, earliest on ties", "[X]") {
+    std::string csv = "TripID,PickupZoneID,PickupTime,DropoffZoneID\n";
+    long long id = 0;
+    for (int z = 0; z < 500; z++)
+        for (int r = 0; r < z % 13 + 1; r++)
+            csv += std::to_string(id++) + ",Z" + std::to_string(z) + ",2024-01-01 " + std::to_string((z * 5 + r * r * 3) % 24) + ":00,ONLYDROP\n";
+    // Z_TIE: hours 23 and 2 both peak at 2 trips; hour 2 wins
+    csv += "t1,Z_TIE,2024-01-01 23:00\nt2,Z_TIE,2024-01-01 23:10\nt3,Z_TIE,2024-01-01 02:00\nt4,Z_TIE,2024-01-01 02:30\nt5,Z_TIE,2024-01-01 07:00\n";
+    writeTripsCsv(csv);
+    TripAnalyzer a;
+    a.ingestFile("Trips.csv");
+
+    // Reference: first slot per zone in topBusySlots order
+    std::map<std::string, SlotCount> expected;
+    for (const SlotCount &s : a.topBusySlots(-1))
+        expected.emplace(s.zone, s);
+
+    std::vector<SlotCount> peaks = a.peakHours();
+    REQUIRE(peaks.size() == expected.size()); // ONLYDROP is not a pickup zone
+    size_t i = 0;
+    for (const auto &e : expected) {
+        INFO(e.first);
+        REQUIRE(peaks[i].zone == e.first);
+        REQUIRE(peaks[i].hour == e.second.hour);
+        REQUIRE(peaks[i].count == e.second.count);
+        i++;
+    }
+    REQUIRE(expected["Z_TIE"].hour == 2);
+
+    TripAnalyzer approx;
+    approx.setApproximateMode(4096);
+    approx.ingestFile("Trips.csv");
+    std::vector<SlotCount> approxPeaks = approx.peakHours();
+    REQUIRE(approxPeaks.size() == peaks.size());
+    REQUIRE(std::is_sorted(approxPeaks.begin(), approxPeaks.end(),
+                           [](const SlotCount &x, const SlotCount &y) { return x.zone < y.zone; }));
+}
+
+TEST_CASE_METHOD(TripsFixture, "X23 Snapshots can be read from another thread during ingest", "[X]") {
+    std::string csv = "TripID,PickupZoneID,PickupTime\n";
+    for (int i = 0; i < 400000; i++)
+        csv += std::to_string(i) + ",Z" + std::to_string(i % 97) + ",2024-01-01 " + std::to_string(i % 24) + ":00\n";
+    writeTripsCsv(csv);
+
+    TripAnalyzer a;
+    REQUIRE_FALSE(a.snapshot());
+    a.setSnapshotInterval(1);
+
+    std::atomic<bool> done{false};
+    std::atomic<int> inconsistent{0};
+    std::atomic<int> seen{0};
+    std::thread reader([&] {
+        long long lastSequence = 0, lastTrips = 0;
+        while (!done.load()) {
+            TripAnalyzer::SnapshotReader snap = a.snapshot();
+            if (!snap) continue;
+            long long total = 0;
+            for (const ZoneCount &z : snap->topZones(-1)) total += z.count;
+            long long slotTotal = 0;
+            for (const SlotCount &s : snap->topBusySlots(-1)) slotTotal += s.count;
+            if (total != snap->trips || slotTotal != snap->trips || snap->sequence < lastSequence || snap->trips < lastTrips)
+                inconsistent++;
+            if (snap->sequence != lastSequence) seen++;
+            lastSequence = snap->sequence;
+            lastTrips = snap->trips;
+        }
+    });
+    a.ingestFile("Trips.csv");
+    done = true;
+    reader.join();
+
+    REQUIRE(inconsistent.load() == 0);
+    REQUIRE(seen.load() >= 1);
+    TripAnalyzer::SnapshotReader last = a.snapshot();
+    REQUIRE(last);
+    REQUIRE(last->final);
+    REQUIRE(last->sequence > 1); // published mid-file too
+    REQUIRE(last->trips == 400000);
+    std::vector<ZoneCount> live = a.topZones(-1), snap = last->topZones(-1);
+    REQUIRE(live.size() == snap.size());
+    for (size_t i = 0; i < live.size(); i++) {
+        REQUIRE(live[i].zone == snap[i].zone);
+        REQUIRE(live[i].count == snap[i].count);
+    }
+    REQUIRE(last->topBusySlots(3)[0].count == a.topBusySlots(3)[0].count);
+}
+
+TEST_CASE_METHOD(TripsFixture, "X24 Parallel ingest and ranking match the sequential path", "[X]") {
+    std::string csv = "TripID,PickupZoneID,DropoffZoneID,PickupTime,Distance,Fare\n";
+    unsigned x = 12345;
+    auto next = [&x] { x = x * 1103515245u + 12345u; return (x >> 8) % 1000003u; };
+    for (int i = 0; i < 150000; i++) {
+        unsigned r = next();
+        if (r % 97 == 0) { csv += "garbage line\n"; continue; }
+        if (r % 89 == 0) { csv += "\n"; continue; }
+        std::string zone = "Z" + std::to_string(r % 40000);
+        std::string drop = "D" + std::to_string(next() % 300);
+        char when[32];
+        std::snprintf(when, sizeof(when), "2024-%02u-%02u %02u:%02u", 1 + r % 12, 1 + r % 28, next() % 24, r % 60);
+        csv += std::to_string(i) + "," + zone + "," + drop + "," + when + "," +
+               std::to_string(r % 50) + "." + std::to_string(r % 10) + "," + std::to_string(r % 90) + ".25\n";
+    }
+    writeTripsCsv(csv);
+
+    auto configure = [](TripAnalyzer &a) {
+        a.setFareStats(true);
+        a.setTimeBuckets(true);
+        a.setDailyIndex(true);
+    };
+    TripAnalyzer seq, par;
+    configure(seq);
+    configure(par);
+    par.setThreads(4);
+    seq.ingestFile("Trips.csv");
+    par.ingestFile("Trips.csv");
+
+    requireSameRankings(seq, par);
+    std::vector<ZoneCount> d1 = seq.topZones(5, "2024-03-01", "2024-06-30");
+    std::vector<ZoneCount> d2 = par.topZones(5, "2024-03-01", "2024-06-30");
+    REQUIRE(d1.size() == d2.size());
+    for (size_t i = 0; i < d1.size(); i++) {
+        REQUIRE(d1[i].zone == d2[i].zone);
+        REQUIRE(d1[i].count == d2[i].count);
+    }
+    std::vector<ZoneRevenue> v1 = seq.topZonesByRevenue(20), v2 = par.topZonesByRevenue(20);
+    for (size_t i = 0; i < v1.size(); i++) {
+        REQUIRE(v1[i].zone == v2[i].zone);
+        REQUIRE(v1[i].revenue == v2[i].revenue);
+    }
+    FareStats f1 = seq.zoneFareStats("Z17"), f2 = par.zoneFareStats("Z17");
+    REQUIRE(f1.fareRows == f2.fareRows);
+    REQUIRE(f1.fareSum == f2.fareSum);
+    REQUIRE(f1.fareMax == f2.fareMax);
+    REQUIRE(f1.distanceMax == f2.distanceMax);
+    for (TimeGranularity g : {TimeGranularity::QuarterHour, TimeGranularity::DayOfWeek, TimeGranularity::Date}) {
+        std::vector<TimeSlotCount> t1 = seq.topSlots(30, g), t2 = par.topSlots(30, g);
+        REQUIRE(t1.size() == t2.size());
+        for (size_t i = 0; i < t1.size(); i++) {
+            REQUIRE(t1[i].zone == t2[i].zone);
+            REQUIRE(t1[i].bucket == t2[i].bucket);
+            REQUIRE(t1[i].count == t2[i].count);
+        }
+    }
+
+    const IngestStats &a = seq.ingestStats(), &b = par.ingestStats();
+    REQUIRE(a.blankLines == b.blankLines);
+    REQUIRE(a.headerRows == b.headerRows);
+    REQUIRE(b.read.backend == ReaderBackend::Mmap);
+
+    std::vector<WorkerStats> workers = par.workerStats();
+    REQUIRE(workers.size() == 4);
+    long long tasks = 0;
+    for (const WorkerStats &w : workers) tasks += w.tasks;
+    REQUIRE(tasks > 4);
+    REQUIRE(seq.workerStats().empty());
+
+    // Order-dependent options keep ingest sequential
+    TripAnalyzer dedup;
+    dedup.setThreads(4);
+    dedup.setTripIdDedup(200000);
+    dedup.ingestFile("Trips.csv");
+    REQUIRE(dedup.ingestStats().rowsAccepted == a.rowsAccepted);
+    REQUIRE(dedup.ingestStats().read.backend != ReaderBackend::Mmap);
+}
+
+TEST_CASE_METHOD(TripsFixture, "X25 Shared and per-worker zone tables give identical results", "[X]") {
+    auto makeCsv = [](int rows, unsigned zones) {
+        std::string csv = "TripID,PickupZoneID,PickupTime\n";
+        unsigned x = 7;
+        for (int i = 0; i < rows; i++) {
+            x = x * 1103515245u + 12345u;
+            unsigned r = x >> 8;
+            if (r % 101 == 0) { csv += std::to_string(i) + ",,2024-01-01 10:00\n"; continue; }
+            csv += std::to_string(i) + ",Z" + std::to_string(r % zones) + ",2024-01-01 " + std::to_string(r % 24) + ":00\n";
+        }
+        return csv;
+    };
+
+    SECTION("Auto picks per-worker tables for few zones and shared for many") {
+        writeTripsCsv(makeCsv(200000, 300));
+        TripAnalyzer seq, few;
+        few.setThreads(3);
+        seq.ingestFile("Trips.csv");
+        few.ingestFile("Trips.csv");
+        REQUIRE_FALSE(few.ingestStats().sharedZoneTable);
+        requireSameRankings(seq, few);
+
+        writeTripsCsv(makeCsv(200000, 100000));
+        TripAnalyzer seq2, many, perWorker;
+        many.setThreads(3);
+        perWorker.setThreads(3);
+        perWorker.setZoneTableMode(ZoneTableMode::PerWorker);
+        seq2.ingestFile("Trips.csv");
+        many.ingestFile("Trips.csv");
+        perWorker.ingestFile("Trips.csv");
+        REQUIRE(many.ingestStats().sharedZoneTable);
+        REQUIRE_FALSE(perWorker.ingestStats().sharedZoneTable);
+        requireSameRankings(seq2, many);
+        requireSameRankings(seq2, perWorker);
+    }
+
+    SECTION("The shared table overflows into shards and grows between waves") {
+        // 200k zones against an initial 64k capacity; ~19 MB is two waves
+        // for two workers
+        writeTripsCsv(makeCsv(700000, 200000));
+        TripAnalyzer seq, shared;
+        shared.setThreads(2);
+        shared.setZoneTableMode(ZoneTableMode::Shared);
+        seq.ingestFile("Trips.csv");
+        shared.ingestFile("Trips.csv");
+        REQUIRE(shared.ingestStats().sharedZoneTable);
+        requireSameRankings(seq, shared);
+    }
+
+    SECTION("SharedZoneCounts refuses new zones when full, from many threads") {
+        SharedZoneCounts table(1000);
+        std::atomic<long long> refused{0};
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; t++)
+            threads.emplace_back([&, t] {
+                for (int i = 0; i < 3000; i++)
+                    if (!table.add("Z" + std::to_string((i * 7 + t) % 1500), i % 24)) refused++;
+            });
+        for (std::thread &th : threads) th.join();
+        REQUIRE(table.size() == 1000);
+        long long counted = 0;
+        for (uint32_t id = 0; id < table.size(); id++) {
+            counted += table.count(id);
+            long long hours = 0;
+            for (int h = 0; h < 24; h++) hours += table.hourly(id, h);
+            REQUIRE(hours == table.count(id));
+        }
+        REQUIRE(counted + refused.load() == 12000);
+
+        std::string first = table.name(0);
+        long long firstCount = table.count(0);
+        table.reserve(4000);
+        REQUIRE(table.name(0) == first);
+        REQUIRE(table.count(0) == firstCount);
+        for (int z = 0; z < 1500; z++) REQUIRE(table.add("Z" + std::to_string(z), 0));
+        REQUIRE(table.size() == 1500);
+    }
+
+    SECTION("The 6-column layout takes the shared table; fare stats do not") {
+        std::string csv = "TripID,PickupZoneID,DropoffZoneID,PickupTime,Distance,Fare\n";
+        unsigned x = 11;
+        for (int i = 0; i < 200000; i++) {
+            x = x * 1103515245u + 12345u;
+            unsigned r = x >> 8;
+            csv += std::to_string(i) + ",Z" + std::to_string(r % 50000) + ",Z" + std::to_string((r / 7) % 50000) +
+                   ",2024-01-01 " + std::to_string(r % 24) + ":00," + std::to_string(r % 30) + ".5,12.25\n";
+        }
+        writeTripsCsv(csv);
+        TripAnalyzer seq, shared;
+        shared.setThreads(3);
+        seq.ingestFile("Trips.csv");
+        shared.ingestFile("Trips.csv");
+        REQUIRE(shared.ingestStats().sharedZoneTable);
+        REQUIRE(shared.topRoutes(-1).size() > 100000);
+        requireSameRankings(seq, shared);
+
+        TripAnalyzer fares;
+        fares.setThreads(3);
+        fares.setFareStats(true);
+        fares.setZoneTableMode(ZoneTableMode::Shared);
+        fares.ingestFile("Trips.csv");
+        REQUIRE_FALSE(fares.ingestStats().sharedZoneTable);
+        requireSameRankings(seq, fares);
+    }
+}
+
+TEST_CASE_METHOD(TripsFixture, "X26 NUMA node groups keep results exact", "[X]") {
+    REQUIRE(parseCpuList("0-3,8,10-11") == std::vector<int>{0, 1, 2, 3, 8, 10, 11});
+    REQUIRE(parseCpuList("5") == std::vector<int>{5});
+    REQUIRE(parseCpuList("").empty());
+
+    NumaTopology detected = NumaTopology::detect();
+    REQUIRE(detected.nodes() >= 1);
+
+    // Two "nodes" on whatever CPUs this machine has, so workers can pin
+    NumaTopology twoNodes;
+    twoNodes.nodeCpus = {detected.nodeCpus[0], detected.nodeCpus[0]};
+
+    SECTION("Workers split into contiguous node groups and steal within them") {
+        WorkStealingPool pool(5, twoNodes);
+        REQUIRE(pool.nodes() == 2);
+        std::vector<int> expected = {0, 0, 0, 1, 1};
+        for (int w = 0; w < 5; w++) REQUIRE(pool.nodeOf(w) == expected[w]);
+
+        std::vector<std::atomic<int>> ran(1000);
+        std::vector<std::atomic<int>> ranOn(1000);
+        pool.run(ran.size(), [&](int worker, size_t index) {
+            ran[index]++;
+            ranOn[index] = pool.nodeOf(worker);
+        }, true);
+        for (size_t i = 0; i < ran.size(); i++) REQUIRE(ran[i] == 1);
+        // Contiguous blocks: 200 tasks per worker, so 0..599 belong to node 0
+        for (size_t i = 0; i < ran.size(); i++) REQUIRE(ranOn[i] == (i < 600 ? 0 : 1));
+        std::vector<WorkerStats> stats = pool.stats();
+        for (int w = 0; w < 5; w++) REQUIRE(stats[w].node == expected[w]);
+        // Resetting clears the counters, not the placement
+        pool.resetStats();
+        stats = pool.stats();
+        for (int w = 0; w < 5; w++) {
+            REQUIRE(stats[w].node == expected[w]);
+            REQUIRE(stats[w].tasks == 0);
+            REQUIRE(pool.nodeOf(w) == expected[w]);
+        }
+    }
+
+    SECTION("Per-node shard merge matches the sequential path") {
+        std::string csv = "TripID,PickupZoneID,DropoffZoneID,PickupTime,Distance,Fare\n";
+        unsigned x = 99;
+        for (int i = 0; i < 120000; i++) {
+            x = x * 1103515245u + 12345u;
+            unsigned r = x >> 8;
+            csv += std::to_string(i) + ",Z" + std::to_string(r % 30000) + ",D" + std::to_string(r % 200) +
+                   ",2024-02-" + std::to_string(10 + r % 9) + " " + std::to_string(r % 24) + ":15," +
+                   std::to_string(r % 30) + ".5," + std::to_string(r % 70) + ".75\n";
+        }
+        writeTripsCsv(csv);
+
+        TripAnalyzer seq, par;
+        seq.setFareStats(true);
+        par.setFareStats(true);
+        par.setThreads(4, twoNodes);
+        seq.ingestFile("Trips.csv");
+        par.ingestFile("Trips.csv");
+
+        requireSameRankings(seq, par);
+
+        std::vector<WorkerStats> stats = par.workerStats();
+        REQUIRE(stats.size() == 4);
+        REQUIRE(stats[0].node == 0);
+        REQUIRE(stats[3].node == 1);
+    }
+}
+
+TEST_CASE_METHOD(TripsFixture, "X27 Memory budget spills to disk and stays exact", "[X]") {
+    auto makeCsv = [](int rows, unsigned seed) {
+        std::string csv = "TripID,PickupZoneID,DropoffZoneID,PickupTime\n";
+        unsigned x = seed;
+        for (int i = 0; i < rows; i++) {
+            x = x * 1103515245u + 12345u;
+            unsigned r = x >> 8;
+            if (r % 97 == 0) { csv += "bad row\n"; continue; }
+            csv += std::to_string(i) + ",Z" + std::to_string(r % 60000) + ",D" + std::to_string((r >> 4) % 400) +
+                   ",2024-01-01 " + std::to_string((r >> 3) % 24) + ":00\n";
+        }
+        return csv;
+    };
+    // Rankings plus the point lookups, which read spill partitions
+    auto same = [](const TripAnalyzer &a, const TripAnalyzer &b) {
+        requireSameRankings(a, b);
+        std::vector<std::string_view> probe = {"Z1", "Z59999", "Z123", "missing", "Z1"};
+        REQUIRE(a.zoneCounts(probe) == b.zoneCounts(probe));
+        for (std::string_view z : probe) {
+            REQUIRE(a.zoneCount(z) == b.zoneCount(z));
+            REQUIRE(a.estimateSlot(z, 3) == b.estimateSlot(z, 3));
+        }
+    };
+
+    SECTION("A small budget spills several times and every query matches") {
+        writeTripsCsv(makeCsv(200000, 11));
+        TripAnalyzer full, budget;
+        budget.setMemoryBudget(1 << 20);
+        full.ingestFile("Trips.csv");
+        budget.ingestFile("Trips.csv");
+        REQUIRE_FALSE(full.spilled());
+        REQUIRE(budget.spilled());
+        REQUIRE(budget.ingestStats().spills > 1);
+        REQUIRE(budget.ingestStats().spillBytes > 0);
+        // An eighth of 1 MB per partition needs more than the first 64
+        REQUIRE(budget.ingestStats().spillPartitions > SpillStore::MinPartitions);
+        REQUIRE(budget.zoneHourly("Z1").empty());
+        same(full, budget);
+    }
+
+    SECTION("Files ingested after a spill add to the spilled counts") {
+        TripAnalyzer full, budget;
+        budget.setMemoryBudget(1 << 20);
+        writeTripsCsv(makeCsv(120000, 5));
+        full.ingestFile("Trips.csv");
+        budget.ingestFile("Trips.csv");
+        writeTripsCsv(makeCsv(2000, 6)); // fits in memory, spilled at the end
+        full.ingestFile("Trips.csv");
+        budget.ingestFile("Trips.csv");
+        REQUIRE(budget.ingestStats().spills == 1);
+        same(full, budget);
+    }
+
+    SECTION("A generous budget never spills") {
+        writeTripsCsv(makeCsv(20000, 3));
+        TripAnalyzer a;
+        a.setMemoryBudget(size_t(1) << 30);
+        a.ingestFile("Trips.csv");
+        REQUIRE_FALSE(a.spilled());
+        REQUIRE(a.ingestStats().spills == 0);
+    }
+
+    SECTION("Fare stats or an unwritable directory keep everything in memory") {
+        writeTripsCsv(makeCsv(50000, 9));
+        TripAnalyzer full, fares, nowhere;
+        fares.setFareStats(true);
+        fares.setMemoryBudget(1 << 16);
+        nowhere.setMemoryBudget(1 << 16, "/nonexistent/spill/dir");
+        full.ingestFile("Trips.csv");
+        fares.ingestFile("Trips.csv");
+        nowhere.ingestFile("Trips.csv");
+        REQUIRE_FALSE(fares.spilled());
+        REQUIRE_FALSE(nowhere.spilled());
+        same(full, nowhere);
+        requireSameRankings(full, fares);
+    }
+}
+
+TEST_CASE_METHOD(TripsFixture, "X28 TripAnalyzer is movable; snapshots stay pinned", "[X]") {
+    static_assert(std::is_nothrow_move_constructible<TripAnalyzer>::value, "TripAnalyzer is movable");
+    std::string csv = "TripID,PickupZoneID,PickupTime\n";
+    for (int i = 0; i < 20000; i++)
+        csv += std::to_string(i) + ",Z" + std::to_string(i % 97) + ",2024-01-01 " + std::to_string(i % 24) + ":00\n";
+    writeTripsCsv(csv);
+
+    // The snapshot cell moves with the analyzer, so a pinned snapshot
+    // outlives the source (the target is declared first to outlive it)
+    TripAnalyzer target;
+    TripAnalyzer a;
+    a.setSnapshotInterval(1);
+    a.ingestFile("Trips.csv");
+    TripAnalyzer moved(std::move(a));
+    TripAnalyzer::SnapshotReader pinned = moved.snapshot();
+    REQUIRE(pinned);
+    target = std::move(moved);
+    REQUIRE(pinned->trips == 20000);
+    REQUIRE(target.snapshot()->sequence == pinned->sequence);
+    REQUIRE(target.topZonesAtHour(5, 3).size() == 3);
+    REQUIRE(target.topZones(1)[0].count == 207);
+
+    // Approximate mode: the Space-Saving summaries move too
+    TripAnalyzer approx;
+    approx.setApproximateMode(50);
+    approx.ingestFile("Trips.csv");
+    std::vector<ApproxZoneCount> before = approx.topZonesApprox(5);
+    TripAnalyzer approxMoved(std::move(approx));
+    std::vector<ApproxZoneCount> after = approxMoved.topZonesApprox(5);
+    REQUIRE(after.size() == before.size());
+    for (size_t i = 0; i < after.size(); i++) {
+        REQUIRE(after[i].zone == before[i].zone);
+        REQUIRE(after[i].count == before[i].count);
+    }
+}
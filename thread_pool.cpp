@@ -0,0 +1,248 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#define TRIP_HAVE_AFFINITY 1
+#endif
+
+std::vector<int> parseCpuList(const std::string &list)
+{
+    std::vector<int> cpus;
+    std::stringstream in(list);
+    std::string item;
+    while (std::getline(in, item, ','))
+    {
+        if (item.empty() || !std::isdigit(static_cast<unsigned char>(item[0])))
+            continue;
+        char *end = nullptr;
+        long first = std::strtol(item.c_str(), &end, 10);
+        long last = first;
+        if (*end == '-')
+            last = std::strtol(end + 1, nullptr, 10);
+        for (long c = first; c <= last; ++c)
+            cpus.push_back(static_cast<int>(c));
+    }
+    return cpus;
+}
+
+static std::string readFirstLine(const std::string &path)
+{
+    std::ifstream f(path);
+    std::string line;
+    std::getline(f, line);
+    return line;
+}
+
+NumaTopology NumaTopology::detect()
+{
+    NumaTopology topology;
+#ifdef TRIP_HAVE_AFFINITY
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    bool haveAllowed = ::sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+    for (int node : parseCpuList(readFirstLine("/sys/devices/system/node/online")))
+    {
+        std::vector<int> cpus;
+        for (int cpu : parseCpuList(readFirstLine("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist")))
+        {
+            if (!haveAllowed || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)))
+                cpus.push_back(cpu);
+        }
+        if (!cpus.empty()) // memory-only nodes run no workers
+            topology.nodeCpus.push_back(cpus);
+    }
+#endif
+    if (topology.nodeCpus.empty())
+        topology.nodeCpus.push_back({}); // one node, no pinning
+    return topology;
+}
+
+WorkStealingPool::WorkStealingPool(int workers, const NumaTopology &topology)
+{
+    workers = std::max(workers, 1);
+    _nodes = static_cast<int>(std::max<size_t>(topology.nodes(), 1));
+    for (int i = 0; i < workers; ++i)
+    {
+        // Contiguous worker blocks per node, sized in proportion
+        _workers.emplace_back(new Worker(static_cast<int>(static_cast<long long>(i) * _nodes / workers)));
+    }
+
+    for (int i = 0; i < workers; ++i)
+    {
+        std::vector<int> order{i};
+        for (int j = 1; j < workers; ++j)
+        {
+            int v = (i + j) % workers;
+            if (nodeOf(v) == nodeOf(i))
+                order.push_back(v);
+        }
+        _localVictims.push_back(order.size());
+        for (int j = 1; j < workers; ++j)
+        {
+            int v = (i + j) % workers;
+            if (nodeOf(v) != nodeOf(i))
+                order.push_back(v);
+        }
+        _victims.push_back(order);
+    }
+
+    for (int i = 0; i < workers; ++i)
+    {
+        // Pin only when there is a node structure to respect
+        std::vector<int> cpus = _nodes > 1 ? topology.nodeCpus[nodeOf(i)] : std::vector<int>();
+        _workers[i]->thread = std::thread(&WorkStealingPool::workerLoop, this, i, cpus);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(_jobLock);
+        _stop = true;
+    }
+    _wake.notify_all();
+    for (std::unique_ptr<Worker> &w : _workers)
+        w->thread.join();
+}
+
+void WorkStealingPool::run(size_t tasks, const std::function<void(int, size_t)> &task, bool nodeLocal)
+{
+    if (tasks == 0)
+        return;
+    std::lock_guard<std::mutex> runGuard(_runLock);
+    _nodeLocal = nodeLocal;
+
+    // Contiguous blocks, the remainder spread over the first workers
+    size_t workers = _workers.size();
+    size_t next = 0;
+    for (size_t w = 0; w < workers; ++w)
+    {
+        size_t share = tasks / workers + (w < tasks % workers ? 1 : 0);
+        std::lock_guard<std::mutex> guard(_workers[w]->lock);
+        for (size_t i = 0; i < share; ++i)
+            _workers[w]->tasks.push_back(next++);
+    }
+
+    std::unique_lock<std::mutex> job(_jobLock);
+    _task = &task;
+    _active = static_cast<int>(workers);
+    _generation++;
+    _wake.notify_all();
+    _done.wait(job, [this]
+               { return _active == 0; });
+    _task = nullptr;
+}
+
+// Own deque from the front, then the other deques from the back: same
+// node first, each list starting after `self` so thieves spread over
+// victims
+bool WorkStealingPool::takeTask(int self, size_t &index, bool &stolen)
+{
+    const std::vector<int> &victims = _victims[self];
+    size_t count = _nodeLocal ? _localVictims[self] : victims.size();
+    for (size_t i = 0; i < count; ++i)
+    {
+        Worker &victim = *_workers[victims[i]];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (victim.tasks.empty())
+            continue;
+        if (i == 0)
+        {
+            index = victim.tasks.front();
+            victim.tasks.pop_front();
+        }
+        else
+        {
+            index = victim.tasks.back();
+            victim.tasks.pop_back();
+        }
+        stolen = i != 0;
+        return true;
+    }
+    return false;
+}
+
+void WorkStealingPool::workerLoop(int self, std::vector<int> cpus)
+{
+#ifdef TRIP_HAVE_AFFINITY
+    // Pin before the first task, so everything this worker allocates and
+    // first touches lands on its node. Failure (e.g. a restricted
+    // cpuset) just leaves the thread unpinned.
+    if (!cpus.empty())
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus)
+        {
+            if (cpu < CPU_SETSIZE)
+                CPU_SET(cpu, &set);
+        }
+        ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+    }
+#else
+    (void)cpus;
+#endif
+    Worker &me = *_workers[self];
+    unsigned long long seen = 0;
+    for (;;)
+    {
+        const std::function<void(int, size_t)> *task;
+        {
+            std::unique_lock<std::mutex> job(_jobLock);
+            _wake.wait(job, [&]
+                       { return _stop || _generation != seen; });
+            if (_stop)
+                return;
+            seen = _generation;
+            task = _task;
+        }
+
+        // No task is added during a job, so once every deque is empty
+        // there is nothing left to take
+        size_t index;
+        bool stolen;
+        while (takeTask(self, index, stolen))
+        {
+            auto t0 = std::chrono::steady_clock::now();
+            (*task)(self, index);
+            long long nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+            std::lock_guard<std::mutex> guard(me.lock);
+            me.stats.tasks++;
+            me.stats.steals += stolen;
+            me.stats.busyNanos += nanos;
+        }
+
+        std::lock_guard<std::mutex> job(_jobLock);
+        if (--_active == 0)
+            _done.notify_all();
+    }
+}
+
+std::vector<WorkerStats> WorkStealingPool::stats() const
+{
+    std::vector<WorkerStats> out;
+    for (const std::unique_ptr<Worker> &w : _workers)
+    {
+        std::lock_guard<std::mutex> guard(w->lock);
+        out.push_back(w->stats);
+        out.back().node = w->node;
+    }
+    return out;
+}
+
+void WorkStealingPool::resetStats()
+{
+    for (std::unique_ptr<Worker> &w : _workers)
+    {
+        std::lock_guard<std::mutex> guard(w->lock);
+        w->stats = WorkerStats();
+    }
+}
@@ -0,0 +1,105 @@
+#pragma once
+// Small work-stealing thread pool for TripAnalyzer's parallel ingest, shard
+// merge and ranking.
+//
+// run() takes a batch of fine-grained tasks (indices 0..tasks-1), deals
+// them out to per-worker deques in contiguous blocks, and returns once all
+// have run. A worker takes tasks from the front of its own deque, so
+// neighbouring byte ranges of a file stay on one thread. When its deque is
+// empty it steals from the back of another worker's deque, so a slow block
+// (dirty rows, very long lines) is shared out instead of leaving the other
+// workers idle. Deques are guarded by one mutex each. Tasks are at least
+// tens of microseconds long, so the locks never show up in a profile.
+//
+// On a multi-node (NUMA) machine workers are split into per-node groups in
+// worker order and pinned to their node's CPUs, so contiguous task blocks
+// (neighbouring byte ranges) run on one node. Thieves try workers on their
+// own node first.
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct WorkerStats
+{
+    int node = 0;            // NUMA node the worker is pinned to
+    long long tasks = 0;     // tasks run, own and stolen
+    long long steals = 0;    // tasks taken from another worker's deque
+    long long busyNanos = 0; // time spent inside tasks
+};
+
+// NUMA nodes and their CPUs, read from /sys/devices/system/node (no
+// libnuma), limited to the CPUs this process may run on. A single node
+// holding every allowed CPU when sysfs has no node information or on
+// other systems.
+struct NumaTopology
+{
+    std::vector<std::vector<int>> nodeCpus; // node -> CPU ids
+
+    static NumaTopology detect();
+    size_t nodes() const { return nodeCpus.size(); }
+};
+
+// "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11} (sysfs cpulist format)
+std::vector<int> parseCpuList(const std::string &list);
+
+class WorkStealingPool
+{
+public:
+    // With more than one node in `topology`, workers are pinned per node
+    explicit WorkStealingPool(int workers, const NumaTopology &topology = NumaTopology::detect());
+    ~WorkStealingPool();
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    int size() const { return static_cast<int>(_workers.size()); }
+    int nodes() const { return _nodes; }
+    int nodeOf(int worker) const { return _workers[worker]->node; }
+
+    // Runs task(worker, index) for every index in [0, tasks) and waits.
+    // `worker` is 0..size()-1, so tasks can keep per-worker state without
+    // locking. With `nodeLocal`, tasks are only stolen within a node.
+    // Calls from different threads are serialised.
+    void run(size_t tasks, const std::function<void(int worker, size_t index)> &task, bool nodeLocal = false);
+
+    // Counters since construction or the last resetStats(), by worker
+    std::vector<WorkerStats> stats() const;
+    void resetStats();
+
+private:
+    struct Worker
+    {
+        explicit Worker(int node) : node(node) {}
+
+        const int node; // fixed at construction, read without the lock
+        std::mutex lock;
+        std::deque<size_t> tasks;
+        WorkerStats stats; // counters only; stats() fills in the node
+        std::thread thread;
+    };
+
+    void workerLoop(int self, std::vector<int> cpus);
+    bool takeTask(int self, size_t &index, bool &stolen);
+
+    std::vector<std::unique_ptr<Worker>> _workers;
+    std::vector<std::vector<int>> _victims; // per worker: self, own node, the rest
+    std::vector<size_t> _localVictims;      // per worker: self + own node
+    int _nodes = 1;
+    bool _nodeLocal = false;
+    std::mutex _runLock; // one run() at a time
+
+    // Job hand-off: run() bumps _generation and waits for _active to drop
+    // back to zero
+    std::mutex _jobLock;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+    const std::function<void(int, size_t)> *_task = nullptr;
+    unsigned long long _generation = 0;
+    int _active = 0;
+    bool _stop = false;
+};
@@ -0,0 +1,206 @@
+#include "trip_generator.h"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+// splitmix64: tiny, fast and fully deterministic across platforms
+struct GenRng
+{
+    unsigned long long state;
+
+    unsigned long long next()
+    {
+        unsigned long long z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    double uniform() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+    int below(int n) { return static_cast<int>(next() % static_cast<unsigned long long>(n)); }
+};
+
+// Zone picker: uniform, or Zipf(s) by inverting a precomputed CDF
+class ZonePicker
+{
+public:
+    ZonePicker(int zones, double s) : _zones(std::max(1, zones))
+    {
+        if (s <= 0.0)
+            return;
+        _cdf.resize(_zones);
+        double sum = 0.0;
+        for (int i = 0; i < _zones; ++i)
+        {
+            sum += 1.0 / std::pow(static_cast<double>(i + 1), s);
+            _cdf[i] = sum;
+        }
+        for (double &c : _cdf)
+            c /= sum;
+    }
+
+    int pick(GenRng &rng) const
+    {
+        if (_cdf.empty())
+            return rng.below(_zones);
+        auto it = std::lower_bound(_cdf.begin(), _cdf.end(), rng.uniform());
+        return it == _cdf.end() ? _zones - 1 : static_cast<int>(it - _cdf.begin());
+    }
+
+private:
+    int _zones;
+    std::vector<double> _cdf;
+};
+
+static void appendInt(std::string &out, long long v, int width = 0)
+{
+    char buf[24];
+    auto res = std::to_chars(buf, buf + sizeof(buf), v);
+    int len = static_cast<int>(res.ptr - buf);
+    for (int i = len; i < width; ++i)
+        out.push_back('0');
+    out.append(buf, res.ptr);
+}
+
+static void appendZone(std::string &out, int zone, bool quoted)
+{
+    if (quoted)
+    {
+        out += "\"ZONE";
+        appendInt(out, zone, 4);
+        out += ", North\"";
+        return;
+    }
+    out += "ZONE";
+    appendInt(out, zone, 4);
+}
+
+static void appendTime(std::string &out, GenRng &rng)
+{
+    out += "2024-";
+    appendInt(out, 1 + rng.below(12), 2);
+    out.push_back('-');
+    appendInt(out, 1 + rng.below(28), 2);
+    out.push_back(' ');
+    appendInt(out, rng.below(24), 2);
+    out.push_back(':');
+    appendInt(out, rng.below(60), 2);
+}
+
+static void appendDecimal(std::string &out, GenRng &rng, int maxTenths)
+{
+    int tenths = 1 + rng.below(maxTenths);
+    appendInt(out, tenths / 10);
+    out.push_back('.');
+    appendInt(out, tenths % 10);
+}
+
+// One malformed row per reject reason, round robin
+static void appendDirtyRow(std::string &out, long long id, int kind)
+{
+    appendInt(out, id);
+    switch (kind % 7)
+    {
+    case 0:
+        out += ",ZONE0001";
+        break;
+    case 1:
+        out += ",,2024-01-01 10:00";
+        break;
+    case 2:
+        out += ",ZONE0001,";
+        break;
+    case 3:
+        out += ",ZONE0001,NOT_A_TIME";
+        break;
+    case 4:
+        out += ",ZONE0001,2024-01-01 10";
+        break;
+    case 5:
+        out += ",ZONE0001,2024-01-01 xx:00";
+        break;
+    default:
+        out += ",ZONE0001,2024-01-01 25:00";
+        break;
+    }
+    out.push_back('\n');
+}
+
+// Rows are formatted into a block of about this size, then written out
+static const size_t GenBlockBytes = size_t(1) << 20;
+
+bool writeTrips(std::ostream &stream, const TripGenConfig &config)
+{
+    GenRng rng{config.seed};
+    ZonePicker picker(config.zones, config.zipf);
+    bool wide = config.columns >= 6;
+
+    std::string out;
+    out.reserve(GenBlockBytes + 256);
+    auto flush = [&]()
+    {
+        stream.write(out.data(), static_cast<std::streamsize>(out.size()));
+        out.clear();
+    };
+
+    if (config.header)
+        out += wide ? "TripID,PickupZoneID,DropoffZoneID,PickupTime,Distance,Fare\n"
+                    : "TripID,PickupZoneID,PickupTime\n";
+
+    int dirtyKind = 0;
+    for (long long i = 0; i < config.rows; ++i)
+    {
+        if (out.size() >= GenBlockBytes)
+        {
+            flush();
+            if (!stream)
+                return false;
+        }
+        long long id = 1000000 + i;
+        if (config.dirtyRatio > 0.0 && rng.uniform() < config.dirtyRatio)
+        {
+            appendDirtyRow(out, id, dirtyKind++);
+            continue;
+        }
+        bool quoted = config.quotedRatio > 0.0 && rng.uniform() < config.quotedRatio;
+
+        appendInt(out, id);
+        out.push_back(',');
+        appendZone(out, picker.pick(rng), quoted);
+        out.push_back(',');
+        if (wide)
+        {
+            appendZone(out, picker.pick(rng), false);
+            out.push_back(',');
+        }
+        appendTime(out, rng);
+        if (wide)
+        {
+            out.push_back(',');
+            appendDecimal(out, rng, 500);
+            out.push_back(',');
+            appendDecimal(out, rng, 2000);
+        }
+        out.push_back('\n');
+    }
+    flush();
+    return stream.good();
+}
+
+std::string generateTrips(const TripGenConfig &config)
+{
+    std::ostringstream out;
+    writeTrips(out, config);
+    return out.str();
+}
+
+bool writeTrips(const std::string &path, const TripGenConfig &config)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open())
+        return false;
+    return writeTrips(file, config) && file.flush().good();
+}
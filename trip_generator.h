@@ -0,0 +1,24 @@
+#pragma once
+#include <ostream>
+#include <string>
+
+// Shape of a synthetic trips CSV
+struct TripGenConfig
+{
+    long long rows = 1000000;
+    int zones = 1000;          // distinct pickup/dropoff zone IDs
+    double zipf = 0.0;         // zone popularity skew, 0 = uniform
+    double dirtyRatio = 0.0;   // fraction of malformed rows (all reject kinds, round robin)
+    double quotedRatio = 0.0;  // fraction of rows whose zone is quoted and contains the delimiter
+    int columns = 6;           // 3 = TripID,PickupZoneID,PickupTime; 6 = production layout
+    bool header = true;
+    unsigned long long seed = 42;
+};
+
+// Same config, same bytes
+std::string generateTrips(const TripGenConfig &config);
+
+// Streams the same bytes in fixed-size blocks, so memory stays flat
+// however many rows are asked for
+bool writeTrips(std::ostream &out, const TripGenConfig &config);
+bool writeTrips(const std::string &path, const TripGenConfig &config);
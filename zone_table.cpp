@@ -0,0 +1,305 @@
+#include "zone_table.h"
+#include "sketches.h"
+#include <algorithm>
+
+// -------------------- ZoneTable --------------------
+size_t ZoneTable::probe(std::string_view name, uint64_t hash) const
+{
+    size_t mask = _slots.size() - 1;
+    for (size_t i = static_cast<size_t>(hash) & mask;; i = (i + 1) & mask)
+    {
+        const Slot &s = _slots[i];
+        if (s.id == NotFound || (s.hash == hash && _names[s.id] == name))
+            return i;
+    }
+}
+
+uint32_t ZoneTable::find(std::string_view name) const
+{
+    if (_slots.empty())
+        return NotFound;
+    return _slots[probe(name, sketchHash(name))].id;
+}
+
+void ZoneTable::findBatch(const std::string_view *names, size_t n, uint32_t *ids) const
+{
+    if (_slots.empty())
+    {
+        for (size_t i = 0; i < n; ++i)
+            ids[i] = NotFound;
+        return;
+    }
+    const size_t Group = 16;
+    size_t mask = _slots.size() - 1;
+    uint64_t hashes[Group];
+    for (size_t base = 0; base < n; base += Group)
+    {
+        size_t count = std::min(Group, n - base);
+        for (size_t i = 0; i < count; ++i)
+        {
+            hashes[i] = sketchHash(names[base + i]);
+            __builtin_prefetch(&_slots[static_cast<size_t>(hashes[i]) & mask]);
+        }
+        for (size_t i = 0; i < count; ++i)
+            ids[base + i] = _slots[probe(names[base + i], hashes[i])].id;
+    }
+}
+
+uint32_t ZoneTable::intern(std::string_view name)
+{
+    if ((_names.size() + 1) * 2 > _slots.size())
+        grow();
+    uint64_t hash = sketchHash(name);
+    Slot &s = _slots[probe(name, hash)];
+    if (s.id == NotFound)
+    {
+        s.hash = hash;
+        s.id = static_cast<uint32_t>(_names.size());
+        _names.emplace_back(name);
+        _nameBytes += name.size();
+    }
+    return s.id;
+}
+
+void ZoneTable::grow()
+{
+    std::vector<Slot> old;
+    old.swap(_slots);
+    _slots.assign(old.empty() ? 64 : old.size() * 2, Slot{0, NotFound});
+    size_t mask = _slots.size() - 1;
+    for (const Slot &s : old)
+    {
+        if (s.id == NotFound)
+            continue;
+        size_t i = static_cast<size_t>(s.hash) & mask;
+        while (_slots[i].id != NotFound)
+            i = (i + 1) & mask;
+        _slots[i] = s;
+    }
+}
+
+double ZoneTable::loadFactor() const
+{
+    return _slots.empty() ? 0.0 : static_cast<double>(_names.size()) / static_cast<double>(_slots.size());
+}
+
+void ZoneTable::clear()
+{
+    _slots.clear();
+    _names.clear();
+    _nameBytes = 0;
+}
+
+size_t ZoneTable::memoryBytes(size_t more) const
+{
+    size_t names = _names.size() + more;
+    size_t slots = _slots.size();
+    while (names * 2 > slots)
+        slots = slots ? slots * 2 : 64;
+    size_t nameSlots = _names.capacity();
+    if (names > nameSlots)
+        nameSlots = std::max(names, nameSlots * 2);
+    size_t averageName = _names.empty() ? 16 : _nameBytes / _names.size() + 1;
+    return slots * sizeof(Slot) + nameSlots * sizeof(std::string) + _nameBytes + more * averageName;
+}
+
+// -------------------- IdPairCounts --------------------
+// Keys are dense ids, so mix before masking
+static inline size_t pairSlot(uint64_t key, size_t mask)
+{
+    key ^= key >> 29;
+    key *= 0xBF58476D1CE4E5B9ULL;
+    key ^= key >> 32;
+    return static_cast<size_t>(key) & mask;
+}
+
+void IdPairCounts::insert(uint64_t k, long long weight, size_t slot)
+{
+    size_t mask = _slots.size() - 1;
+    for (size_t i = slot;; i = (i + 1) & mask)
+    {
+        Entry &e = _slots[i];
+        if (e.key == k)
+        {
+            e.count += weight;
+            return;
+        }
+        if (e.key == Empty)
+        {
+            e = {k, weight};
+            _size++;
+            return;
+        }
+    }
+}
+
+void IdPairCounts::add(uint32_t first, uint32_t second, long long weight)
+{
+    flush();
+    if ((_size + 1) * 2 > _slots.size())
+        grow();
+    uint64_t k = key(first, second);
+    insert(k, weight, pairSlot(k, _slots.size() - 1));
+}
+
+void IdPairCounts::flush()
+{
+    if (_pendingCount == 0)
+        return;
+    while ((_size + _pendingCount) * 2 > _slots.size())
+        grow();
+
+    size_t mask = _slots.size() - 1;
+    size_t slots[BatchSize];
+    for (size_t i = 0; i < _pendingCount; ++i)
+    {
+        slots[i] = pairSlot(_pending[i], mask);
+        __builtin_prefetch(&_slots[slots[i]], 1);
+    }
+    for (size_t i = 0; i < _pendingCount; ++i)
+        insert(_pending[i], 1, slots[i]);
+    _pendingCount = 0;
+}
+
+long long IdPairCounts::get(uint32_t first, uint32_t second) const
+{
+    if (_slots.empty())
+        return 0;
+    uint64_t k = key(first, second);
+    size_t mask = _slots.size() - 1;
+    for (size_t i = pairSlot(k, mask);; i = (i + 1) & mask)
+    {
+        const Entry &e = _slots[i];
+        if (e.key == k)
+            return e.count;
+        if (e.key == Empty)
+            return 0;
+    }
+}
+
+void IdPairCounts::grow()
+{
+    std::vector<Entry> old;
+    old.swap(_slots);
+    _slots.assign(old.empty() ? 64 : old.size() * 2, Entry{Empty, 0});
+    size_t mask = _slots.size() - 1;
+    for (const Entry &e : old)
+    {
+        if (e.key == Empty)
+            continue;
+        size_t i = pairSlot(e.key, mask);
+        while (_slots[i].key != Empty)
+            i = (i + 1) & mask;
+        _slots[i] = e;
+    }
+}
+
+void IdPairCounts::clear()
+{
+    _slots.clear();
+    _size = 0;
+    _pendingCount = 0;
+}
+
+size_t IdPairCounts::memoryBytes(size_t more) const
+{
+    size_t pairs = _size + _pendingCount + more;
+    size_t slots = _slots.size();
+    while (pairs * 2 > slots)
+        slots = slots ? slots * 2 : 64;
+    return slots * sizeof(Entry);
+}
+
+// -------------------- SharedZoneCounts --------------------
+bool SharedZoneCounts::add(std::string_view zone, int hour)
+{
+    uint64_t hash = sketchHash(zone) | 1;
+    size_t mask = _slotCount - 1;
+    for (size_t i = static_cast<size_t>(hash) & mask;; i = (i + 1) & mask)
+    {
+        Slot &s = _slots[i];
+        uint64_t seen = s.hash.load(std::memory_order_acquire);
+        if (seen == 0)
+        {
+            // Do not claim slots once full; at most one Overflow slot per
+            // racing thread, so the table never fills up
+            if (_size.load(std::memory_order_relaxed) >= _capacity)
+                return false;
+            if (s.hash.compare_exchange_strong(seen, hash, std::memory_order_acq_rel))
+            {
+                uint32_t id = _size.fetch_add(1, std::memory_order_relaxed);
+                if (id >= _capacity)
+                {
+                    s.id.store(Overflow, std::memory_order_release);
+                    return false;
+                }
+                _names[id].assign(zone.data(), zone.size());
+                s.id.store(id, std::memory_order_release);
+                bump(id, hour);
+                return true;
+            }
+            // Lost the race; `seen` now holds the winner's hash
+        }
+        if (seen != hash)
+            continue;
+
+        // Pending: another thread is still storing the id. Rather than
+        // wait for it, count this row elsewhere; Overflow likewise (maybe
+        // this zone, maybe not). Shards merge by name, so both are safe.
+        uint32_t id = s.id.load(std::memory_order_acquire);
+        if (id == Pending || id == Overflow)
+            return false;
+        if (_names[id] == zone)
+        {
+            bump(id, hour);
+            return true;
+        }
+    }
+}
+
+void SharedZoneCounts::reserve(size_t capacity)
+{
+    size_t zones = size();
+    capacity = std::max(capacity, zones);
+    size_t slotCount = 64;
+    while (slotCount < capacity * 2)
+        slotCount *= 2;
+
+    std::unique_ptr<Slot[]> slots(new Slot[slotCount]);
+    std::unique_ptr<std::string[]> names(new std::string[capacity]);
+    std::unique_ptr<std::atomic<long long>[]> counts(new std::atomic<long long>[capacity]);
+    std::unique_ptr<std::atomic<long long>[]> hourly(new std::atomic<long long>[capacity * 24]);
+    for (size_t id = 0; id < capacity; ++id)
+        counts[id].store(id < zones ? _counts[id].load() : 0, std::memory_order_relaxed);
+    for (size_t c = 0; c < capacity * 24; ++c)
+        hourly[c].store(c < zones * 24 ? _hourly[c].load() : 0, std::memory_order_relaxed);
+
+    // Rehash the zones that made it in; Overflow slots are dropped, so
+    // their zones can get an id now
+    for (size_t i = 0; i < _slotCount; ++i)
+    {
+        uint32_t id = _slots[i].id.load();
+        if (id >= zones)
+            continue;
+        uint64_t hash = _slots[i].hash.load();
+        size_t j = static_cast<size_t>(hash) & (slotCount - 1);
+        while (slots[j].hash.load(std::memory_order_relaxed) != 0)
+            j = (j + 1) & (slotCount - 1);
+        slots[j].hash.store(hash, std::memory_order_relaxed);
+        slots[j].id.store(id, std::memory_order_relaxed);
+        names[id] = std::move(_names[id]);
+    }
+
+    _capacity = capacity;
+    _slotCount = slotCount;
+    _slots = std::move(slots);
+    _names = std::move(names);
+    _counts = std::move(counts);
+    _hourly = std::move(hourly);
+    _size.store(static_cast<uint32_t>(zones));
+}
+
+size_t SharedZoneCounts::size() const
+{
+    return std::min<size_t>(_size.load(std::memory_order_relaxed), _capacity);
+}
@@ -0,0 +1,206 @@
+#pragma once
+// Interning and id-keyed counting for TripAnalyzer's exact aggregates.
+// Zone names are mapped to dense ids once per row; everything downstream
+// (per-zone totals, hourly cells, pair counts) is indexed by id instead of
+// hashing the name again.
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Open-addressing map from zone name to a dense id (0, 1, 2, ... in first
+// seen order). Lookups take a string_view and never allocate.
+class ZoneTable
+{
+public:
+    static const uint32_t NotFound = UINT32_MAX;
+
+    // Id of `name`, adding it if it is new
+    uint32_t intern(std::string_view name);
+    uint32_t find(std::string_view name) const;
+    // find() for n names at once: hashes a group, prefetches its slots,
+    // then probes, so the cache misses of a group overlap
+    void findBatch(const std::string_view *names, size_t n, uint32_t *ids) const;
+
+    const std::string &name(uint32_t id) const { return _names[id]; }
+    const std::vector<std::string> &names() const { return _names; }
+    size_t size() const { return _names.size(); }
+    size_t bucketCount() const { return _slots.size(); }
+    double loadFactor() const;
+    void clear();
+
+    // Approximate heap bytes once `more` new names are interned, counting
+    // the table and name array growth they would trigger
+    size_t memoryBytes(size_t more = 0) const;
+
+private:
+    struct Slot
+    {
+        uint64_t hash;
+        uint32_t id; // NotFound = empty
+    };
+
+    size_t probe(std::string_view name, uint64_t hash) const;
+    void grow();
+
+    std::vector<Slot> _slots; // power-of-two size, at most 1/2 full
+    std::vector<std::string> _names;
+    size_t _nameBytes = 0; // sum of name lengths
+};
+
+// Open-addressing counter keyed by an ordered pair of 32-bit ids. With many
+// distinct pairs the table outgrows the caches and each update is a cache
+// miss, so add() only queues the key; every BatchSize keys the batch is
+// hashed and prefetched in one sweep and applied in a second, keeping
+// several misses in flight. Call flush() before reading.
+class IdPairCounts
+{
+public:
+    struct Entry
+    {
+        uint64_t key; // first << 32 | second
+        long long count;
+    };
+
+    static uint64_t key(uint32_t first, uint32_t second)
+    {
+        return static_cast<uint64_t>(first) << 32 | second;
+    }
+
+    void add(uint32_t first, uint32_t second)
+    {
+        _pending[_pendingCount++] = key(first, second);
+        if (_pendingCount == BatchSize)
+            flush();
+    }
+    void add(uint32_t first, uint32_t second, long long weight);
+    void flush();
+
+    long long get(uint32_t first, uint32_t second) const;
+
+    size_t size() const { return _size; }
+    void clear();
+
+    // Heap bytes once `more` new pairs are added, counting the growth
+    // they would trigger
+    size_t memoryBytes(size_t more = 0) const;
+
+    // Occupied entries, in no particular order
+    template <typename Fn>
+    void forEach(Fn fn) const
+    {
+        for (const Entry &e : _slots)
+        {
+            if (e.key != Empty)
+                fn(static_cast<uint32_t>(e.key >> 32), static_cast<uint32_t>(e.key), e.count);
+        }
+    }
+
+private:
+    static const uint64_t Empty = UINT64_MAX;
+    static const size_t BatchSize = 32;
+    void grow();
+    void insert(uint64_t k, long long weight, size_t slot);
+
+    std::vector<Entry> _slots; // power-of-two size, at most 1/2 full
+    size_t _size = 0;
+    uint64_t _pending[BatchSize];
+    size_t _pendingCount = 0;
+};
+
+// Pickup and hourly counts by zone name, shared by all parallel-ingest
+// workers when there are too many zones for one table per worker.
+//
+// Open addressing over a fixed array of slots. add() never waits on
+// another thread: a new zone claims an empty slot with one
+// compare-and-swap on its hash, takes the next id, writes its name and
+// then publishes the id. A thread that finds its hash claimed but the id
+// not yet published returns false instead of waiting. Counters are
+// relaxed atomic increments. The table does not grow while workers run.
+// Once `capacity` zones are in, add() also returns false for new zones.
+// On false the caller counts the row elsewhere. reserve() grows the table
+// between batches, when no worker is running.
+class SharedZoneCounts
+{
+public:
+    explicit SharedZoneCounts(size_t capacity) { reserve(capacity); }
+
+    // Counts one trip in `zone` at `hour`; false (nothing counted) if the
+    // zone is new and the table is full, or its slot is still being
+    // published by another thread
+    bool add(std::string_view zone, int hour);
+
+    // Single-threaded: room for at least `capacity` zones. Ids stay.
+    void reserve(size_t capacity);
+
+    size_t size() const;
+    size_t capacity() const { return _capacity; }
+    const std::string &name(uint32_t id) const { return _names[id]; }
+    long long count(uint32_t id) const { return _counts[id].load(std::memory_order_relaxed); }
+    long long hourly(uint32_t id, int hour) const
+    {
+        return _hourly[static_cast<size_t>(id) * 24 + hour].load(std::memory_order_relaxed);
+    }
+
+private:
+    static const uint32_t Pending = UINT32_MAX;      // hash claimed, id not yet stored
+    static const uint32_t Overflow = UINT32_MAX - 1; // claimed when the table was full
+
+    struct Slot
+    {
+        std::atomic<uint64_t> hash{0}; // 0 = empty; stored hashes are odd
+        std::atomic<uint32_t> id{Pending};
+    };
+
+    void bump(uint32_t id, int hour)
+    {
+        _counts[id].fetch_add(1, std::memory_order_relaxed);
+        _hourly[static_cast<size_t>(id) * 24 + hour].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    size_t _capacity = 0;
+    size_t _slotCount = 0; // power of two, at least 2 * _capacity
+    std::unique_ptr<Slot[]> _slots;
+    std::unique_ptr<std::string[]> _names;
+    std::unique_ptr<std::atomic<long long>[]> _counts;
+    std::unique_ptr<std::atomic<long long>[]> _hourly; // id * 24 + hour
+    std::atomic<uint32_t> _size{0};                    // may pass _capacity
+};
+
+// Sum, count and maximum of one fixed-point column per index, kept as
+// separate arrays (structure of arrays) so updates touch only what they
+// change and a ranking pass streams a single array
+struct FixedPointColumn
+{
+    std::vector<long long> sum;
+    std::vector<long long> count;
+    std::vector<long long> max; // LLONG_MIN until the first value
+
+    void resize(size_t n)
+    {
+        sum.resize(n, 0);
+        count.resize(n, 0);
+        max.resize(n, LLONG_MIN);
+    }
+
+    void add(size_t i, long long value)
+    {
+        sum[i] += value;
+        count[i]++;
+        if (value > max[i])
+            max[i] = value;
+    }
+
+    // Folds cell j of `other` into cell i
+    void merge(size_t i, const FixedPointColumn &other, size_t j)
+    {
+        sum[i] += other.sum[j];
+        count[i] += other.count[j];
+        if (other.max[j] > max[i])
+            max[i] = other.max[j];
+    }
+};